@@ -0,0 +1,65 @@
+import sys
+import torch
+from getopt import getopt
+from pathlib import Path
+from torch.export import export, Dim
+from quantize_stems import UNetCore, load_float_model
+from utils import stem_names
+
+# Compile the LarsNet stem models ahead of time with AOTInductor for the plugin's AOTInductor backend.
+#
+# UNet.fold_unet_inputs always hands forward_impl [N, 2, 2048, 512] segments, so only the segment count
+# is dynamic and every kernel is generated for that fixed shape. The folding itself runs in the plugin
+# (LarsNetSegmentAdapter). Needs torch >= 2.2 (.so), >= 2.6 writes .pt2 packages; the plugin's libtorch
+# must be the same version. Point the plugin at the models with a backend config, e.g.
+#   {"kick": {"backend": "aotinductor", "model": "aoti/kick.pt2"}}  and  LARS_BACKEND_CONFIG=<config.json>
+#
+# usage: python export_aot.py [-i <folder with my_scripted_module_<stem>.pt>] [-o <output folder>]
+#                             [-m <max segments per call, default 256 (~50 min of audio)>]
+
+F = 2048
+T = 512
+
+
+def compile_core(core, path, max_segments):
+    example = torch.rand(2, 2, F, T)
+    dynamic_shapes = {'x': {0: Dim('segments', min=1, max=max_segments)}}
+
+    with torch.no_grad():
+        if hasattr(torch._inductor, 'aoti_compile_and_package'):
+            program = export(core, (example,), dynamic_shapes=dynamic_shapes)
+            return torch._inductor.aoti_compile_and_package(program, package_path=str(path.with_suffix('.pt2')))
+
+        return torch._export.aot_compile(core, (example,), dynamic_shapes=dynamic_shapes,
+                                         options={'aot_inductor.output_path': str(path.with_suffix('.so'))})
+
+
+def check_compiled(path, core, num_segments=3):
+    if not hasattr(torch._inductor, 'aoti_load_package') or not str(path).endswith('.pt2'):
+        print('  no package loader in this torch version, skipping the output check')
+        return
+
+    compiled = torch._inductor.aoti_load_package(path)
+    x = torch.rand(num_segments, 2, F, T)
+
+    with torch.no_grad():
+        err = (compiled(x) - core(x)).abs().max().item()
+
+    print(f'  max abs error against eager: {err:.3e}')
+    assert err < 1e-4, f'compiled output for {path} does not match the eager model'
+
+
+if __name__ == '__main__':
+    opts, _ = getopt(sys.argv[1:], 'i:o:m:')
+    opts = dict(opts)
+    folder = opts.get('-i', '.')
+    output = Path(opts.get('-o', 'aoti'))
+    max_segments = int(opts.get('-m', 256))
+    output.mkdir(parents=True, exist_ok=True)
+
+    for stem in stem_names:
+        print(f'> {stem}')
+        core = UNetCore(load_float_model(folder, stem)).eval()
+        path = compile_core(core, output.joinpath(stem), max_segments)
+        check_compiled(path, core)
+        print(f'  saved {path}')
@@ -0,0 +1,51 @@
+import sys
+import torch
+from getopt import getopt
+from unet import UNet
+from unet_ensemble import UNetEnsemble
+from utils import stem_names
+
+# Stack the five scripted LarsNet models into a single grouped-convolution ensemble
+# and script it for the plugin (Resources/my_scripted_module_ensemble.pt).
+#
+# usage: python export_ensemble.py [-i <folder with my_scripted_module_<stem>.pt>] [-o <output .pt>]
+
+F = 2048
+T = 512
+
+
+def load_stem_models(folder):
+    models = []
+    for stem in stem_names:
+        scripted = torch.jit.load(f'{folder}/my_scripted_module_{stem}.pt', map_location='cpu')
+        model = UNet(input_size=(2, F, T), device='cpu')
+        model.load_state_dict(scripted.state_dict())
+        model.eval()
+        models.append(model)
+    return models
+
+
+def check_ensemble(models, ensemble, frames=700):
+    x = torch.rand(1, 2, F + 1, frames)
+    with torch.no_grad():
+        y = ensemble(x)
+        for s, (stem, model) in enumerate(zip(stem_names, models)):
+            err = (y[:, s] - model(x)).abs().max().item()
+            print(f'{stem}: max abs error {err:.3e}')
+            assert err < 1e-4, f'ensemble output for {stem} does not match the stem model'
+
+
+if __name__ == '__main__':
+    opts, _ = getopt(sys.argv[1:], 'i:o:')
+    opts = dict(opts)
+    folder = opts.get('-i', '.')
+    output = opts.get('-o', 'my_scripted_module_ensemble.pt')
+
+    models = load_stem_models(folder)
+    ensemble = UNetEnsemble(models).eval()
+
+    check_ensemble(models, ensemble)
+
+    scripted_ensemble = torch.jit.script(ensemble)
+    scripted_ensemble.save(output)
+    print(f'saved {output}')
@@ -0,0 +1,58 @@
+import sys
+import torch
+from getopt import getopt
+from pathlib import Path
+from quantize_stems import UNetCore, load_float_model
+from utils import stem_names
+
+# Export the LarsNet stem models to ONNX for the plugin's ONNX Runtime backend.
+#
+# Only the UNet core (forward_impl) is exported, with a dynamic segment axis: [S, 2, 2048, 512] -> mask.
+# The 512-frame folding depends on the input length, so the plugin does it around the graph
+# (LarsNetSegmentAdapter). Point the plugin at the models with a backend config, e.g.
+#   {"kick": {"backend": "onnxruntime", "model": "onnx/kick.onnx"}}  and  LARS_BACKEND_CONFIG=<config.json>
+#
+# usage: python export_onnx.py [-i <folder with my_scripted_module_<stem>.pt>] [-o <output folder>] [-p <opset>]
+
+F = 2048
+T = 512
+
+
+def check_onnx(path, core, num_segments=3):
+    try:
+        import onnxruntime as ort
+    except ImportError:
+        print('  onnxruntime not installed, skipping the output check')
+        return
+
+    x = torch.rand(num_segments, 2, F, T)
+    session = ort.InferenceSession(str(path), providers=['CPUExecutionProvider'])
+    y_ort = session.run(None, {session.get_inputs()[0].name: x.numpy()})[0]
+
+    with torch.no_grad():
+        y = core(x)
+
+    err = (torch.from_numpy(y_ort) - y).abs().max().item()
+    print(f'  max abs error against libtorch: {err:.3e}')
+    assert err < 1e-4, f'ONNX Runtime output for {path} does not match the libtorch model'
+
+
+if __name__ == '__main__':
+    opts, _ = getopt(sys.argv[1:], 'i:o:p:')
+    opts = dict(opts)
+    folder = opts.get('-i', '.')
+    output = Path(opts.get('-o', 'onnx'))
+    opset = int(opts.get('-p', 17))
+    output.mkdir(parents=True, exist_ok=True)
+
+    for stem in stem_names:
+        print(f'> {stem}')
+        core = UNetCore(load_float_model(folder, stem)).eval()
+        path = output.joinpath(f'{stem}.onnx')
+
+        torch.onnx.export(core, torch.rand(1, 2, F, T), str(path), opset_version=opset,
+                          input_names=['segments'], output_names=['mask'],
+                          dynamic_axes={'segments': {0: 'num_segments'}, 'mask': {0: 'num_segments'}})
+
+        check_onnx(path, core)
+        print(f'  saved {path}')
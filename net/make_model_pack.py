@@ -0,0 +1,93 @@
+import sys
+import struct
+from getopt import getopt
+from pathlib import Path
+
+# Bundle the plugin's TorchScript models into one memory-mappable model pack (see src/ModelPack.h).
+#
+# usage: python make_model_pack.py -o <LARS.modelpack> <name>=<file.pt> [<name>=<file.pt> ...]
+#        python make_model_pack.py -o <LARS.modelpack> -i <Resources folder>
+#
+# With -i the standard files are picked up from the folder: my_scripted_module_<stem>.pt,
+# my_scripted_module_<stem>_int8.pt (only if int8_gate.json passed), my_scripted_module_ensemble.pt
+# and model_jit.pth (HTDemucs).
+
+MAGIC = b'LARSPACK'
+VERSION = 1
+NAME_LENGTH = 64
+ALIGNMENT = 4096
+
+stems = ['kick', 'snare', 'toms', 'hihat', 'cymbals']
+
+
+def align(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def entries_from_folder(folder, with_int8=True, with_ensemble=True):
+    import json
+
+    folder = Path(folder)
+    entries = {stem: folder.joinpath(f'my_scripted_module_{stem}.pt') for stem in stems}
+
+    gate = folder.joinpath('int8_gate.json')
+    if with_int8 and gate.exists() and json.loads(gate.read_text()).get('passed', False):
+        entries.update({f'{stem}_int8': folder.joinpath(f'my_scripted_module_{stem}_int8.pt') for stem in stems})
+
+    ensemble = folder.joinpath('my_scripted_module_ensemble.pt')
+    if with_ensemble and ensemble.exists():
+        entries['ensemble'] = ensemble
+
+    htdemucs = folder.joinpath('model_jit.pth')
+    if htdemucs.exists():
+        entries['htdemucs'] = htdemucs
+
+    return entries
+
+
+def write_pack(output, entries):
+    names = list(entries)
+    for name in names:
+        assert len(name.encode()) < NAME_LENGTH, f'entry name too long: {name}'
+
+    header_size = 16 + len(names) * (NAME_LENGTH + 16)
+    offset = align(header_size)
+    table = []
+
+    for name in names:
+        size = Path(entries[name]).stat().st_size
+        table.append((name, offset, size))
+        offset = align(offset + size)
+
+    with open(output, 'wb') as f:
+        f.write(MAGIC)
+        f.write(struct.pack('<II', VERSION, len(names)))
+
+        for name, offset, size in table:
+            f.write(name.encode().ljust(NAME_LENGTH, b'\0'))
+            f.write(struct.pack('<QQ', offset, size))
+
+        for name, offset, size in table:
+            f.write(b'\0' * (offset - f.tell()))
+            f.write(Path(entries[name]).read_bytes())
+            print(f'{name}: {size / 2 ** 20:.1f} MB at {offset}')
+
+    print(f'saved {output}')
+
+
+if __name__ == '__main__':
+    opts, args = getopt(sys.argv[1:], 'o:i:', ['no-int8', 'no-ensemble'])
+    flags = [o for o, _ in opts]
+    opts = dict(opts)
+    output = opts.get('-o', 'LARS.modelpack')
+
+    if '-i' in opts:
+        entries = entries_from_folder(opts['-i'], '--no-int8' not in flags, '--no-ensemble' not in flags)
+    else:
+        entries = dict(arg.split('=', 1) for arg in args)
+
+    missing = [str(path) for path in entries.values() if not Path(path).exists()]
+    if missing:
+        sys.exit(f'missing model files: {", ".join(missing)}')
+
+    write_pack(output, entries)
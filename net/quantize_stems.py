@@ -0,0 +1,180 @@
+import sys
+import json
+import math
+import torch
+import torch.nn as nn
+import torch.nn.functional as F
+import pandas as pd
+import torchaudio as ta
+from typing import List
+from pathlib import Path
+from getopt import getopt
+from torch.ao.quantization import get_default_qconfig_mapping, default_qconfig
+from torch.ao.quantization.quantize_fx import prepare_fx, convert_fx
+from unet import UNet, UNetUtils
+from utils import stem_names
+from evaluation import nsdr
+
+# INT8 tier for the LarsNet stem models: post-training static quantization calibrated on the
+# clips of csv/validation.csv, plus the SDR gate that decides whether the tier can ship.
+#
+# usage: python quantize_stems.py [-i <folder with my_scripted_module_<stem>.pt>] [-o <output folder>]
+#                                 [-r <StemGMD root>] [-n <calibration clips>] [-e <eval clips>] [-t <max SDR loss, dB>]
+#
+# Writes my_scripted_module_<stem>_int8.pt and int8_gate.json next to them. CMake only embeds the
+# INT8 modules (-DLARS_WITH_INT8=ON) when int8_gate.json says the tier passed.
+
+SEGMENT = 11.85     # seconds, same as training
+SAMPLE_RATE = 44100
+
+
+class UNetCore(nn.Module):
+    """forward_impl of a UNet as a standalone module, that's the part that gets quantized"""
+
+    def __init__(self, model: UNet):
+        super().__init__()
+        self.model = model
+
+    def forward(self, x):
+        return self.model.forward_impl(x)
+
+
+class QuantizedUNet(nn.Module):
+    """Same interface as UNet: float magnitude in, float separated magnitude out"""
+
+    def __init__(self, core: nn.Module):
+        super().__init__()
+        self.core = core
+
+    def forward(self, x) -> torch.Tensor:
+        input_size = x.size()
+        x = self.fold_unet_inputs(x)
+        i = self.trim_freq_dim(x)
+        mask = self.core(i)
+        mask = self.pad_freq_dim(mask)
+        x_hat = mask * x
+        x_hat = self.unfold_unet_outputs(x_hat, input_size)
+        return x_hat
+
+    def fold_unet_inputs(self, spec):
+        time_dim = spec.size(-1)
+        pad_len = math.ceil(time_dim / 512) * 512 - time_dim
+        padded = F.pad(spec, (0, pad_len))
+        out = torch.cat(torch.split(padded, 512, dim=-1), dim=0)
+        return out
+
+    def trim_freq_dim(self, x):
+        return x[..., :2048, :]
+
+    def pad_freq_dim(self, x):
+        padding = 1
+        x = F.pad(x, (0, 0, 0, padding))
+        return x
+
+    def unfold_unet_outputs(self, x, input_size: List[int]):
+        batch_size, n_frames = input_size[0], input_size[-1]
+        x = torch.cat(torch.split(x, batch_size, dim=0), dim=-1)
+        return x[..., :n_frames]
+
+
+def load_float_model(folder, stem):
+    scripted = torch.jit.load(f'{folder}/my_scripted_module_{stem}.pt', map_location='cpu')
+    model = UNet(input_size=(2, 2048, 512), device='cpu')
+    model.load_state_dict(scripted.state_dict())
+    return model.eval()
+
+
+def load_clips(root, csv, num_clips, stem=None):
+    sources = pd.read_csv(csv, header=None)
+    num_frames = int(SEGMENT * SAMPLE_RATE)
+    for row in sources.head(num_clips).itertuples(index=False):
+        basepath, filename = row[:2]
+        folder = 'mixture' if stem is None else stem
+        x, sr = ta.load(str(Path(root, basepath, folder, filename)), num_frames=num_frames)
+        if x.size(0) == 1:
+            x = x.repeat(2, 1)
+        yield x.unsqueeze(0)
+
+
+def quantize(model, root, csv, num_clips):
+    utils = UNetUtils(device='cpu')
+
+    # ConvTranspose2d only supports per-tensor weight observers in fbgemm/x86
+    qconfig_mapping = get_default_qconfig_mapping('x86').set_object_type(nn.ConvTranspose2d, default_qconfig)
+    example = torch.rand(1, 2, 2048, 512)
+    prepared = prepare_fx(UNetCore(model).eval(), qconfig_mapping, example_inputs=(example,))
+
+    with torch.no_grad():
+        for x in load_clips(root, csv, num_clips):
+            mag, __ = utils.batch_stft(x)
+            segments = model.trim_freq_dim(model.fold_unet_inputs(mag))
+            prepared(segments)
+
+    core = convert_fx(prepared)
+    core = torch.jit.trace(core, example)
+    return QuantizedUNet(core).eval()
+
+
+def separate(model, x, utils):
+    with torch.no_grad():
+        mag, phase = utils.batch_stft(x)
+        mag_hat = model(mag)
+        return utils.batch_istft(mag_hat, phase, trim_length=x.size(-1)).squeeze(0)
+
+
+def sdr_gate(float_model, int8_model, stem, root, csv, num_clips):
+    utils = UNetUtils(device='cpu')
+    float_sdr, int8_sdr = [], []
+
+    for x, y_true in zip(load_clips(root, csv, num_clips), load_clips(root, csv, num_clips, stem)):
+        y_true = y_true.squeeze(0)
+        float_sdr.append(nsdr(separate(float_model, x, utils), y_true).item())
+        int8_sdr.append(nsdr(separate(int8_model, x, utils), y_true).item())
+
+    float_sdr = sum(float_sdr) / len(float_sdr)
+    int8_sdr = sum(int8_sdr) / len(int8_sdr)
+    return float_sdr, int8_sdr
+
+
+def main(argv):
+    opts, _ = getopt(argv, 'i:o:r:n:e:t:')
+    opts = dict(opts)
+    folder = opts.get('-i', '.')
+    output = Path(opts.get('-o', '.'))
+    root = opts.get('-r', 'StemGMD')
+    num_calibration_clips = int(opts.get('-n', 64))
+    num_eval_clips = int(opts.get('-e', 64))
+    threshold = float(opts.get('-t', 0.5))
+    csv = 'csv/validation.csv'
+
+    # calibrate on the head of the validation list, evaluate on the tail
+    eval_csv = output.joinpath('int8_eval_clips.csv')
+    pd.read_csv(csv, header=None).tail(num_eval_clips).to_csv(eval_csv, header=False, index=False)
+
+    gate = {'threshold_db': threshold, 'stems': {}}
+
+    for stem in stem_names:
+        print(f'> {stem}')
+        float_model = load_float_model(folder, stem)
+        int8_model = quantize(float_model, root, csv, num_calibration_clips)
+
+        float_sdr, int8_sdr = sdr_gate(float_model, int8_model, stem, root, eval_csv, num_eval_clips)
+        loss = float_sdr - int8_sdr
+        passed = loss <= threshold
+        print(f'  SDR float32 {float_sdr:.2f} dB, int8 {int8_sdr:.2f} dB, loss {loss:.2f} dB -> '
+              f'{"pass" if passed else "FAIL"}')
+
+        gate['stems'][stem] = {'float32_sdr': float_sdr, 'int8_sdr': int8_sdr, 'loss_db': loss, 'passed': passed}
+        torch.jit.script(int8_model).save(str(output.joinpath(f'my_scripted_module_{stem}_int8.pt')))
+
+    gate['passed'] = all(s['passed'] for s in gate['stems'].values())
+
+    with open(output.joinpath('int8_gate.json'), 'w') as f:
+        json.dump(gate, f, indent=2)
+
+    print(f'INT8 tier {"passed" if gate["passed"] else "did NOT pass"} the {threshold} dB SDR gate')
+    return 0 if gate['passed'] else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,174 @@
+import math
+import torch
+import torch.nn as nn
+import torch.nn.functional as F
+from typing import List
+from unet import UNet
+
+
+class UNetEnsemble(nn.Module):
+    """
+    All the LarsNet stem models in a single graph.
+
+    The stem UNets share the same architecture and only differ in their weights, so every
+    Conv2d / ConvTranspose2d of the ensemble is the concatenation of the stem layers run as a
+    grouped convolution (groups = number of stems), and the BatchNorms are concatenated along the
+    channel axis. Channels are stem-major: [stem0 ch0..chN, stem1 ch0..chN, ...].
+
+    Inference only: BatchNorms use their running statistics and Dropout is dropped.
+
+    Input:  magnitude spectrogram [N, 2, 2049, T]
+    Output: separated magnitudes  [N, S, 2, 2049, T], stems in the order of the models list
+    """
+
+    def __init__(self, models: List[UNet]):
+        super().__init__()
+
+        self.num_stems = len(models)
+        self.audio_channels = models[0].enc1.conv.in_channels
+
+        # Frontend: the per-stem input BatchNorm over the frequency axis becomes a scale and shift
+        scale, shift = zip(*[self._bn_affine(m.input_norm) for m in models])
+        self.register_buffer('input_scale', torch.stack(scale).view(1, self.num_stems, 1, -1, 1))
+        self.register_buffer('input_shift', torch.stack(shift).view(1, self.num_stems, 1, -1, 1))
+
+        # Encoders
+        self.enc1_conv, self.enc1_bn = self._stack_encoder([m.enc1 for m in models])
+        self.enc2_conv, self.enc2_bn = self._stack_encoder([m.enc2 for m in models])
+        self.enc3_conv, self.enc3_bn = self._stack_encoder([m.enc3 for m in models])
+        self.enc4_conv, self.enc4_bn = self._stack_encoder([m.enc4 for m in models])
+        self.enc5_conv, self.enc5_bn = self._stack_encoder([m.enc5 for m in models])
+        self.enc6_conv, self.enc6_bn = self._stack_encoder([m.enc6 for m in models])
+        self.leaky_relu_slope = models[0].enc1.leaky_relu_slope
+
+        # Decoders
+        self.dec1_conv, self.dec1_bn = self._stack_decoder([m.dec1 for m in models])
+        self.dec2_conv, self.dec2_bn = self._stack_decoder([m.dec2 for m in models])
+        self.dec3_conv, self.dec3_bn = self._stack_decoder([m.dec3 for m in models])
+        self.dec4_conv, self.dec4_bn = self._stack_decoder([m.dec4 for m in models])
+        self.dec5_conv, self.dec5_bn = self._stack_decoder([m.dec5 for m in models])
+        self.dec6_conv, self.dec6_bn = self._stack_decoder([m.dec6 for m in models])
+
+        # Mask layer
+        self.mask_conv = self._stack_conv([m.mask_layer[0] for m in models])
+        self.register_buffer('power', torch.tensor([m.power for m in models]).view(1, self.num_stems, 1, 1, 1))
+
+    @staticmethod
+    def _bn_affine(bn: nn.BatchNorm2d):
+        scale = bn.weight / torch.sqrt(bn.running_var + bn.eps)
+        shift = bn.bias - bn.running_mean * scale
+        return scale.detach(), shift.detach()
+
+    @staticmethod
+    def _stack_bn(bns: List[nn.BatchNorm2d]):
+        out = nn.BatchNorm2d(sum(bn.num_features for bn in bns), eps=bns[0].eps)
+        with torch.no_grad():
+            out.weight.copy_(torch.cat([bn.weight for bn in bns]))
+            out.bias.copy_(torch.cat([bn.bias for bn in bns]))
+            out.running_mean.copy_(torch.cat([bn.running_mean for bn in bns]))
+            out.running_var.copy_(torch.cat([bn.running_var for bn in bns]))
+        return out.eval()
+
+    @staticmethod
+    def _stack_conv(convs: List[nn.Conv2d]):
+        c = convs[0]
+        groups = len(convs)
+        out = nn.Conv2d(c.in_channels * groups, c.out_channels * groups, kernel_size=c.kernel_size, stride=c.stride,
+                        padding=c.padding, dilation=c.dilation, groups=groups)
+        with torch.no_grad():
+            # grouped Conv2d weight: [groups * out, in, kH, kW]
+            out.weight.copy_(torch.cat([conv.weight for conv in convs], dim=0))
+            out.bias.copy_(torch.cat([conv.bias for conv in convs], dim=0))
+        return out
+
+    @staticmethod
+    def _stack_conv_transpose(convs: List[nn.ConvTranspose2d]):
+        c = convs[0]
+        groups = len(convs)
+        out = nn.ConvTranspose2d(c.in_channels * groups, c.out_channels * groups, kernel_size=c.kernel_size,
+                                 stride=c.stride, padding=c.padding, output_padding=c.output_padding, groups=groups)
+        with torch.no_grad():
+            # grouped ConvTranspose2d weight: [groups * in, out, kH, kW]
+            out.weight.copy_(torch.cat([conv.weight for conv in convs], dim=0))
+            out.bias.copy_(torch.cat([conv.bias for conv in convs], dim=0))
+        return out
+
+    def _stack_encoder(self, blocks):
+        return self._stack_conv([b.conv for b in blocks]), self._stack_bn([b.bn for b in blocks])
+
+    def _stack_decoder(self, blocks):
+        return self._stack_conv_transpose([b.conv_trans for b in blocks]), self._stack_bn([b.bn for b in blocks])
+
+    def group_cat(self, a, b):
+        # per-stem torch.cat([a, b], dim=1) on stem-major channels
+        n, _, f, t = a.size()
+        a = a.reshape(n, self.num_stems, -1, f, t)
+        b = b.reshape(n, self.num_stems, -1, f, t)
+        return torch.cat([a, b], dim=2).reshape(n, -1, f, t)
+
+    def encode(self, x, conv: nn.Conv2d, bn: nn.BatchNorm2d):
+        c = conv(x)
+        y = F.leaky_relu(bn(c), self.leaky_relu_slope)
+        return y, c
+
+    def decode(self, x, conv: nn.ConvTranspose2d, bn: nn.BatchNorm2d):
+        return bn(F.relu(conv(x)))
+
+    def forward_impl(self, x):
+        n, c, f, t = x.size()
+
+        # Frontend, every stem gets its own normalized copy of the input
+        x = x.unsqueeze(1) * self.input_scale + self.input_shift
+        x = x.reshape(n, self.num_stems * c, f, t)
+
+        # Encoder
+        d, c1 = self.encode(x, self.enc1_conv, self.enc1_bn)
+        d, c2 = self.encode(d, self.enc2_conv, self.enc2_bn)
+        d, c3 = self.encode(d, self.enc3_conv, self.enc3_bn)
+        d, c4 = self.encode(d, self.enc4_conv, self.enc4_bn)
+        d, c5 = self.encode(d, self.enc5_conv, self.enc5_bn)
+        _, c6 = self.encode(d, self.enc6_conv, self.enc6_bn)
+
+        # Decoder
+        u = self.decode(c6, self.dec1_conv, self.dec1_bn)
+        u = self.decode(self.group_cat(c5, u), self.dec2_conv, self.dec2_bn)
+        u = self.decode(self.group_cat(c4, u), self.dec3_conv, self.dec3_bn)
+        u = self.decode(self.group_cat(c3, u), self.dec4_conv, self.dec4_bn)
+        u = self.decode(self.group_cat(c2, u), self.dec5_conv, self.dec5_bn)
+        u = self.decode(self.group_cat(c1, u), self.dec6_conv, self.dec6_bn)
+
+        # Masking
+        mask = torch.sigmoid(self.mask_conv(u))
+        mask = mask.reshape(n, self.num_stems, c, f, t) ** self.power
+
+        return mask
+
+    def forward(self, x) -> torch.Tensor:
+        input_size = x.size()
+        x = self.fold_unet_inputs(x)
+        i = self.trim_freq_dim(x)
+        mask = self.forward_impl(i)
+        mask = self.pad_freq_dim(mask)
+        x_hat = mask * x.unsqueeze(1)
+        x_hat = self.unfold_unet_outputs(x_hat, input_size)
+        return x_hat
+
+    def fold_unet_inputs(self, spec):
+        time_dim = spec.size(-1)
+        pad_len = math.ceil(time_dim / 512) * 512 - time_dim
+        padded = F.pad(spec, (0, pad_len))
+        out = torch.cat(torch.split(padded, 512, dim=-1), dim=0)
+        return out
+
+    def trim_freq_dim(self, x):
+        return x[..., :2048, :]
+
+    def pad_freq_dim(self, x):
+        padding = 1
+        x = F.pad(x, (0, 0, 0, padding))
+        return x
+
+    def unfold_unet_outputs(self, x, input_size: List[int]):
+        batch_size, n_frames = input_size[0], input_size[-1]
+        x = torch.cat(torch.split(x, batch_size, dim=0), dim=-1)
+        return x[..., :n_frames]
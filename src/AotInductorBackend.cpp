@@ -0,0 +1,33 @@
+#include "AotInductorBackend.h"
+
+#if LARS_HAS_AOTI
+
+#include <vector>
+
+
+AotInductorBackend::AotInductorBackend(const juce::File& modelFile)
+{
+    const std::string path = modelFile.getFullPathName().toStdString();
+
+   #if LARS_AOTI_PACKAGES
+    loader = std::make_unique<torch::inductor::AOTIModelPackageLoader>(path);
+   #else
+    runner = std::make_unique<torch::inductor::AOTIModelContainerRunnerCpu>(path);
+   #endif
+}
+
+torch::Tensor AotInductorBackend::run(const torch::Tensor& input) const
+{
+    c10::InferenceMode guard;
+
+    // the generated kernels assume dense float32 inputs
+    std::vector<torch::Tensor> inputs{ input.to(at::kFloat).contiguous() };
+
+   #if LARS_AOTI_PACKAGES
+    return loader->run(inputs)[0];
+   #else
+    return runner->run(inputs)[0];
+   #endif
+}
+
+#endif
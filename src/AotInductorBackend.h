@@ -0,0 +1,49 @@
+#pragma once
+
+#include "InferenceBackend.h"
+
+#include <torch/version.h>
+
+// AOTInductor landed in libtorch 2.2 (shared library + runner); 2.6 switched to .pt2 packages
+#if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 6)
+ #define LARS_HAS_AOTI 1
+ #define LARS_AOTI_PACKAGES 1
+ #include <torch/csrc/inductor/aoti_package/model_package_loader.h>
+#elif TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 2
+ #define LARS_HAS_AOTI 1
+ #define LARS_AOTI_PACKAGES 0
+ #include <torch/csrc/inductor/aoti_runner/model_container_runner_cpu.h>
+#else
+ #define LARS_HAS_AOTI 0
+#endif
+
+#if LARS_HAS_AOTI
+
+//==============================================================================
+/**
+    Runs a model compiled ahead of time by AOTInductor (net/export_aot.py):
+    a .pt2 package on libtorch >= 2.6, a shared library on older versions.
+    The kernels are generated for the fixed [S, 2, 2048, 512] LarsNet segment
+    shape, so there is no TorchScript interpreter, profiling executor or
+    per-op dispatch on the hot path. Wrap it in a LarsNetSegmentAdapter.
+*/
+class AotInductorBackend : public InferenceBackend
+{
+public:
+    /** Throws if the compiled model can't be loaded. */
+    explicit AotInductorBackend(const juce::File& modelFile);
+
+    juce::String getName() const override { return "aotinductor"; }
+    torch::Tensor run(const torch::Tensor& input) const override;
+
+private:
+   #if LARS_AOTI_PACKAGES
+    std::unique_ptr<torch::inductor::AOTIModelPackageLoader> loader;
+   #else
+    std::unique_ptr<torch::inductor::AOTIModelContainerRunnerCpu> runner;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AotInductorBackend)
+};
+
+#endif
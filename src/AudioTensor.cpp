@@ -0,0 +1,86 @@
+#include "AudioTensor.h"
+
+#include <limits>
+#include <stdexcept>
+
+
+std::atomic<juce::int64> AudioTensor::bytesCopied{ 0 };
+
+AudioTensor::AudioTensor(int numChannels, juce::int64 numSamples)
+    : tensor(torch::zeros({ numChannels, numSamples }))
+{
+}
+
+AudioTensor::AudioTensor(const torch::Tensor& t)
+    : tensor(t.dim() == 1 ? t.unsqueeze(0) : t)
+{
+    jassert(tensor.dim() == 2);
+
+    const bool shareable = tensor.scalar_type() == torch::kFloat32 && tensor.device().is_cpu()
+                           && (tensor.stride(1) == 1 || tensor.size(1) <= 1);
+
+    if (!shareable)
+    {
+        tensor = tensor.to(torch::kFloat32).contiguous();
+        countCopy(tensor.numel() * static_cast<juce::int64>(sizeof(float)));
+    }
+}
+
+AudioTensor AudioTensor::copyOf(const juce::AudioBuffer<float>& buffer)
+{
+    AudioTensor audio(torch::empty({ buffer.getNumChannels(), buffer.getNumSamples() }));
+
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        juce::FloatVectorOperations::copy(audio.getWritePointer(ch), buffer.getReadPointer(ch), buffer.getNumSamples());
+
+    countCopy(static_cast<juce::int64>(buffer.getNumChannels()) * buffer.getNumSamples() * static_cast<juce::int64>(sizeof(float)));
+    return audio;
+}
+
+AudioTensor AudioTensor::read(juce::AudioFormatReader& reader, int numChannels)
+{
+    // AudioBuffer sizes are ints, longer files go through a ReaderSampleSource
+    if (reader.lengthInSamples > std::numeric_limits<int>::max())
+        throw std::runtime_error("Audio file too long for an AudioBuffer.");
+
+    const int numSamples = static_cast<int>(reader.lengthInSamples);
+
+    // every sample is written by the reader, there's nothing to clear first
+    AudioTensor audio(torch::empty({ numChannels, static_cast<juce::int64>(numSamples) }));
+    juce::AudioBuffer<float> buffer = audio.getBuffer();
+    reader.read(&buffer, 0, numSamples, 0, true, true);
+
+    return audio;
+}
+
+juce::AudioBuffer<float> AudioTensor::getBuffer() const
+{
+    if (getNumSamples() > std::numeric_limits<int>::max())
+        throw std::runtime_error("Audio too long for an AudioBuffer.");
+
+    const int numChannels = getNumChannels();
+    juce::HeapBlock<float*> channels(static_cast<size_t>(juce::jmax(1, numChannels)));
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[ch] = getWritePointer(ch);
+
+    // the buffer keeps its own copy of the channel pointers, not of the samples
+    return juce::AudioBuffer<float>(channels.get(), numChannels, static_cast<int>(getNumSamples()));
+}
+
+float* AudioTensor::getWritePointer(int channel) const
+{
+    jassert(juce::isPositiveAndBelow(channel, getNumChannels()));
+    return tensor.data_ptr<float>() + channel * tensor.stride(0);
+}
+
+//==============================================================================
+AudioTensorSource::AudioTensorSource(const AudioTensor& a, bool shouldLoop)
+    : AudioTensorSource(a, a.getBuffer(), shouldLoop)
+{
+}
+
+AudioTensorSource::AudioTensorSource(const AudioTensor& a, juce::AudioBuffer<float> samples, bool shouldLoop)
+    : juce::MemoryAudioSource(samples, false, shouldLoop), audio(a)
+{
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <torch/torch.h>
+#include <atomic>
+
+
+//==============================================================================
+/**
+    Planar float audio in one allocation, seen both as a [C, N] torch::Tensor
+    and as a juce::AudioBuffer<float> over the same samples, so audio crosses
+    between the JUCE and libtorch sides without being copied.
+
+    The tensor's storage owns the samples. Copies of an AudioTensor and the
+    tensor from getTensor() share them, and a buffer from getBuffer() stays
+    valid while either is alive. Only each channel has to be contiguous, so a
+    tensor narrowed along its samples is still adopted as it is.
+
+    The copies that are left add to one counter, getBytesCopied(): adopting a
+    tensor with strided channels, copyOf(), and the blocks a SampleSource reads.
+    The editor and LARSBenchmark report it per separation.
+*/
+class AudioTensor
+{
+public:
+    AudioTensor() = default;
+
+    /** numChannels x numSamples of silence. */
+    AudioTensor(int numChannels, juce::int64 numSamples);
+
+    /** Shares the samples of a float32 [C, N] (or [N]) tensor whose channels are contiguous, copies them otherwise. */
+    explicit AudioTensor(const torch::Tensor& tensor);
+
+    /** A copy of buffer's samples. */
+    static AudioTensor copyOf(const juce::AudioBuffer<float>& buffer);
+
+    /** All of reader's audio, read straight into the allocation as numChannels channels
+        (mono is duplicated). Throws for files too long for an AudioBuffer. */
+    static AudioTensor read(juce::AudioFormatReader& reader, int numChannels = 2);
+
+    bool isEmpty() const { return !tensor.defined() || tensor.numel() == 0; }
+    int getNumChannels() const { return tensor.defined() ? static_cast<int>(tensor.size(0)) : 0; }
+    juce::int64 getNumSamples() const { return tensor.defined() ? tensor.size(1) : 0; }
+
+    const torch::Tensor& getTensor() const { return tensor; }
+
+    /** An AudioBuffer referring to the samples. Move it, copying an AudioBuffer copies its samples. */
+    juce::AudioBuffer<float> getBuffer() const;
+
+    float* getWritePointer(int channel) const;
+    const float* getReadPointer(int channel) const { return getWritePointer(channel); }
+
+    /** Bytes copied by the hand-offs since the last reset, on any thread. */
+    static juce::int64 getBytesCopied() { return bytesCopied.load(); }
+    static void resetBytesCopied() { bytesCopied = 0; }
+    static void countCopy(juce::int64 numBytes) { bytesCopied += numBytes; }
+
+private:
+    torch::Tensor tensor;
+
+    static std::atomic<juce::int64> bytesCopied;
+};
+
+//==============================================================================
+/** A MemoryAudioSource playing an AudioTensor's samples in place instead of a copy of them. */
+class AudioTensorSource : public juce::MemoryAudioSource
+{
+public:
+    explicit AudioTensorSource(const AudioTensor& audio, bool shouldLoop = false);
+
+private:
+    AudioTensorSource(const AudioTensor& audio, juce::AudioBuffer<float> samples, bool shouldLoop);
+
+    AudioTensor audio; // keeps the samples the source refers to alive
+};
@@ -0,0 +1,109 @@
+#include "BackendConfig.h"
+#include "AotInductorBackend.h"
+
+
+BackendConfig BackendConfig::fromJson(const juce::String& json, const juce::File& baseDirectory)
+{
+    BackendConfig config;
+
+    const juce::var root = juce::JSON::parse(json);
+    const juce::DynamicObject* models = root.getDynamicObject();
+
+    if (models == nullptr)
+    {
+        DBG("backend config is not a JSON object, every model uses the libtorch JIT");
+        return config;
+    }
+
+    for (const auto& property : models->getProperties())
+    {
+        const juce::var& settings = property.value;
+
+        Entry entry;
+        entry.type = parseType(settings.getProperty("backend", "torchjit").toString());
+        entry.intraOpThreads = static_cast<int>(settings.getProperty("threads", 0));
+
+        const juce::String layout = settings.getProperty("layout", {}).toString().trim().toLowerCase();
+        entry.channelsLast = layout == "channels_last" || layout == "channels-last" || layout == "nhwc";
+
+        const juce::String model = settings.getProperty("model", {}).toString();
+        if (model.isNotEmpty())
+            entry.modelFile = baseDirectory.getChildFile(model);
+
+        config.entries[property.name.toString()] = entry;
+    }
+
+    return config;
+}
+
+BackendConfig BackendConfig::fromFile(const juce::File& file)
+{
+    if (!file.existsAsFile())
+    {
+        DBG("backend config " << file.getFullPathName() << " not found, every model uses the libtorch JIT");
+        return {};
+    }
+
+    return fromJson(file.loadFileAsString(), file.getParentDirectory());
+}
+
+BackendConfig BackendConfig::fromEnvironment()
+{
+    const juce::String path = juce::SystemStats::getEnvironmentVariable("LARS_BACKEND_CONFIG", {});
+
+    if (path.isEmpty())
+        return {};
+
+    return fromFile(juce::File::getCurrentWorkingDirectory().getChildFile(path));
+}
+
+BackendConfig::Entry BackendConfig::getEntry(const juce::String& modelName) const
+{
+    const auto it = entries.find(modelName);
+    return it != entries.end() ? it->second : Entry();
+}
+
+BackendConfig::Type BackendConfig::parseType(const juce::String& name)
+{
+    const juce::String n = name.trim().toLowerCase();
+
+    if (n == "onnxruntime" || n == "ort" || n == "onnx")
+        return Type::onnxRuntime;
+
+    if (n == "aotinductor" || n == "aoti")
+        return Type::aotInductor;
+
+    if (n != "torchjit" && n != "torch")
+        DBG("unknown backend \"" << name << "\", using the libtorch JIT");
+
+    return Type::torchJit;
+}
+
+juce::String BackendConfig::getTypeName(Type type)
+{
+    switch (type)
+    {
+    case Type::onnxRuntime: return "onnxruntime";
+    case Type::aotInductor: return "aotinductor";
+    default:                break;
+    }
+
+    return "torchjit";
+}
+
+bool BackendConfig::isTypeAvailable(Type type)
+{
+    if (type == Type::onnxRuntime)
+    {
+       #if LARS_WITH_ONNXRUNTIME
+        return true;
+       #else
+        return false;
+       #endif
+    }
+
+    if (type == Type::aotInductor)
+        return LARS_HAS_AOTI != 0;
+
+    return true;
+}
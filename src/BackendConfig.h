@@ -0,0 +1,59 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <map>
+
+
+//==============================================================================
+/**
+    Picks the inference runtime per model. Read from a JSON file whose path is
+    in the LARS_BACKEND_CONFIG environment variable; models that aren't listed
+    (or no file at all) use the libtorch JIT. Model names are the stem names
+    and "htdemucs":
+
+    {
+        "kick":     { "backend": "onnxruntime", "model": "onnx/kick.onnx", "threads": 4 },
+        "snare":    { "backend": "torchjit", "layout": "channels_last" },
+        "htdemucs": { "backend": "torchjit" }
+    }
+
+    "model" paths are relative to the config file. ONNX (net/export_onnx.py)
+    and AOTInductor (net/export_aot.py, "backend": "aotinductor") stem models
+    are the LarsNet core only. "layout": "channels_last" runs a libtorch stem
+    layer by layer in channels-last (LarsNetLayerBackend).
+*/
+class BackendConfig
+{
+public:
+    enum class Type
+    {
+        torchJit,
+        onnxRuntime,
+        aotInductor
+    };
+
+    struct Entry
+    {
+        Type type{ Type::torchJit };
+        juce::File modelFile;
+        int intraOpThreads{ 0 };    // 0 = let the runtime decide
+        bool channelsLast{ false };
+    };
+
+    BackendConfig() = default;
+
+    static BackendConfig fromJson(const juce::String& json, const juce::File& baseDirectory);
+    static BackendConfig fromFile(const juce::File& file);
+    static BackendConfig fromEnvironment();
+
+    Entry getEntry(const juce::String& modelName) const;
+
+    static Type parseType(const juce::String& name);
+    static juce::String getTypeName(Type type);
+
+    /** False when the build can't create backends of this type. */
+    static bool isTypeAvailable(Type type);
+
+private:
+    std::map<juce::String, Entry> entries;
+};
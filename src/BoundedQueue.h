@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+//==============================================================================
+/**
+    A blocking FIFO between two pipeline stages. push() waits while capacity
+    items are queued, so a fast producer can't run ahead of a slow consumer by
+    more than that; pop() waits while it is empty. close() wakes both sides:
+    push() then drops the item, pop() drains what's left and then fails.
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    /** false if the queue was closed, the item is dropped. */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /** false once the queue is closed and empty. */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
@@ -31,16 +31,22 @@ public:
 
     }
 
-    int makeConversion(int eventX, int totLen) {
-        return std::floor((( eventX - 58 )/ 720.0 ) * totLen); //!!! IL NUMERO AL DENOMINATORE DEVE ESSERE PARI ALLA LUNGHEZZA DELLE THUMBNAIL !!!
+    juce::int64 makeConversion(int eventX, juce::int64 totLen) {
+        return static_cast<juce::int64>(std::floor((( eventX - 58 )/ 720.0 ) * (double)totLen)); //!!! IL NUMERO AL DENOMINATORE DEVE ESSERE PARI ALLA LUNGHEZZA DELLE THUMBNAIL !!!
     }
 
-    void setSrcInst(juce::MemoryAudioSource* sI){
+    void setSrcInst(juce::PositionableAudioSource* sI){
         srcInst = sI;
         length = srcInst->getTotalLength();
         if (!instIsPresent) instIsPresent = true;
     }
 
+    void clearSrcInst(){
+        srcInst = nullptr;
+        instIsPresent = false;
+        length = 0;
+    }
+
     void setSrc(juce::AudioFormatReaderSource* sF) {
         srcFull = sF;
         length = srcFull->getTotalLength();
@@ -90,7 +96,7 @@ public:
         }
     }
 
-    float getAudioLength(){
+    juce::int64 getAudioLength(){
         return length;
     }
 
@@ -100,7 +106,7 @@ private:
 
 
 
-    juce::MemoryAudioSource* srcInst;
+    juce::PositionableAudioSource* srcInst;
     juce::AudioFormatReaderSource* srcFull;
 
     juce::File fileDir;
@@ -109,7 +115,7 @@ private:
     bool fullIsPresent = false;
     bool instIsPresent = false;
 
-    float length = 0.0;
+    juce::int64 length = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ClickableArea)
 
@@ -0,0 +1,108 @@
+#include "CpuFeatures.h"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+ #define LARS_X86 1
+ #if defined(_MSC_VER)
+  #include <intrin.h>
+ #else
+  #include <cpuid.h>
+ #endif
+#else
+ #define LARS_X86 0
+#endif
+
+
+#if LARS_X86
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+   #if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<uint32_t>(info[i]);
+   #else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+   #endif
+}
+
+static uint64_t readXcr0()
+{
+   #if defined(_MSC_VER)
+    return _xgetbv(0);
+   #else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+   #endif
+}
+
+static bool osSavesXState(uint64_t mask)
+{
+    uint32_t regs[4];
+    cpuid(1, 0, regs);
+
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    return osxsave && (readXcr0() & mask) == mask;
+}
+
+static uint32_t getMaxLeaf()
+{
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    return regs[0];
+}
+#endif
+
+bool CpuFeatures::hasAvx512BF16()
+{
+   #if LARS_X86
+    if (getMaxLeaf() < 7)
+        return false;
+
+    // XCR0: SSE, AVX, opmask, ZMM0-15 upper halves, ZMM16-31
+    if (!osSavesXState(0xe6))
+        return false;
+
+    uint32_t regs[4];
+    cpuid(7, 0, regs);
+    const bool avx512f = (regs[1] & (1u << 16)) != 0;
+    const uint32_t maxSubleaf = regs[0];
+
+    if (!avx512f || maxSubleaf < 1)
+        return false;
+
+    cpuid(7, 1, regs);
+    return (regs[0] & (1u << 5)) != 0;
+   #else
+    return false;
+   #endif
+}
+
+bool CpuFeatures::hasAmxBF16()
+{
+   #if LARS_X86
+    if (getMaxLeaf() < 7)
+        return false;
+
+    // XCR0: XTILECFG and XTILEDATA. On Linux the process still has to request
+    // the tile state (arch_prctl), oneDNN does that before its first AMX kernel.
+    if (!osSavesXState(0x60000))
+        return false;
+
+    uint32_t regs[4];
+    cpuid(7, 0, regs);
+    const bool amxBF16 = (regs[3] & (1u << 22)) != 0;
+    const bool amxTile = (regs[3] & (1u << 24)) != 0;
+    return amxBF16 && amxTile;
+   #else
+    return false;
+   #endif
+}
+
+bool CpuFeatures::supportsBFloat16Inference()
+{
+    static const bool supported = hasAvx512BF16() || hasAmxBF16();
+    return supported;
+}
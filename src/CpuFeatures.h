@@ -0,0 +1,22 @@
+#pragma once
+
+
+//==============================================================================
+/**
+    Runtime detection of the x86 extensions the reduced-precision inference
+    paths rely on. The checks query CPUID and also make sure the OS saves the
+    matching register state, so they are safe to use for dispatch. On non-x86
+    builds everything reports false.
+*/
+class CpuFeatures
+{
+public:
+    /** AVX512F + AVX512_BF16 (Cooper Lake, Sapphire Rapids, Zen 4 and later). */
+    static bool hasAvx512BF16();
+
+    /** AMX tiles with BF16 support (Sapphire Rapids and later). */
+    static bool hasAmxBF16();
+
+    /** True when bfloat16 convolutions run natively instead of being emulated. */
+    static bool supportsBFloat16Inference();
+};
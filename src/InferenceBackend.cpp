@@ -0,0 +1,58 @@
+#include "InferenceBackend.h"
+
+
+TorchJitBackend::TorchJitBackend(torch::jit::script::Module m, at::ScalarType type)
+    : module(std::move(m)), computeType(type)
+{
+}
+
+torch::Tensor TorchJitBackend::run(const torch::Tensor& input) const
+{
+    // Module is a handle onto the shared graph, so a local copy is cheap and
+    // keeps this method free of any per-call state.
+    torch::jit::script::Module m = module;
+
+    c10::InferenceMode guard;
+
+    if (computeType != at::kFloat)
+    {
+        std::vector<torch::jit::IValue> inputs{ input.to(computeType) };
+        return m.forward(inputs).toTensor().to(at::kFloat);
+    }
+
+    std::vector<torch::jit::IValue> inputs{ input };
+    return m.forward(inputs).toTensor();
+}
+
+//==============================================================================
+LarsNetSegmentAdapter::LarsNetSegmentAdapter(std::unique_ptr<InferenceBackend> c)
+    : core(std::move(c))
+{
+}
+
+torch::Tensor LarsNetSegmentAdapter::foldSegments(const torch::Tensor& spec)
+{
+    const int64_t numFrames = spec.size(-1);
+    const int64_t padLength = (numFrames + segmentFrames - 1) / segmentFrames * segmentFrames - numFrames;
+
+    torch::Tensor padded = torch::constant_pad_nd(spec, { 0, padLength });
+    return torch::cat(torch::split(padded, segmentFrames, -1), 0);
+}
+
+torch::Tensor LarsNetSegmentAdapter::unfoldSegments(const torch::Tensor& segments, int64_t batchSize, int64_t numFrames)
+{
+    return torch::cat(torch::split(segments, batchSize, 0), -1).narrow(-1, 0, numFrames);
+}
+
+torch::Tensor LarsNetSegmentAdapter::run(const torch::Tensor& input) const
+{
+    c10::InferenceMode guard;
+
+    const torch::Tensor segments = foldSegments(input);
+
+    // the model sees 2048 bins, the Nyquist bin gets a zero mask
+    torch::Tensor mask = core->run(segments.narrow(-2, 0, modelBins).contiguous());
+    mask = torch::constant_pad_nd(mask, { 0, 0, 0, 1 });
+
+    return unfoldSegments(mask * segments, input.size(0), input.size(-1));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <torch/script.h>
+#include <memory>
+
+
+//==============================================================================
+/**
+    One loaded model behind a runtime. ModelSession only talks to models
+    through this interface, so a model can move from libtorch to another
+    runtime with a config change (see BackendConfig).
+
+    run() must be safe to call from several threads at once.
+*/
+class InferenceBackend
+{
+public:
+    virtual ~InferenceBackend() = default;
+
+    virtual juce::String getName() const = 0;
+
+    /** Float32 in, float32 out, same shapes as the scripted module's forward(). */
+    virtual torch::Tensor run(const torch::Tensor& input) const = 0;
+};
+
+//==============================================================================
+/**
+    The default backend: a TorchScript module run by the libtorch JIT.
+    With computeType = kBFloat16 the module is expected to hold bfloat16
+    weights; inputs are cast on the way in and outputs back to float32.
+*/
+class TorchJitBackend : public InferenceBackend
+{
+public:
+    explicit TorchJitBackend(torch::jit::script::Module m, at::ScalarType computeType = at::kFloat);
+
+    juce::String getName() const override { return "torchjit"; }
+    torch::Tensor run(const torch::Tensor& input) const override;
+
+    const torch::jit::script::Module& getModule() const { return module; }
+
+private:
+    torch::jit::script::Module module;
+    at::ScalarType computeType;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TorchJitBackend)
+};
+
+//==============================================================================
+/**
+    Gives a backend that only runs the LarsNet core (UNet.forward_impl: trimmed
+    [S, 2, 2048, 512] segments in, masks out) the interface of the full model.
+    The 512-frame folding, the frequency trim/pad, the masking and the unfolding
+    that UNet.forward does around forward_impl are done here with libtorch ops,
+    so exported graphs don't need data-dependent shapes.
+*/
+class LarsNetSegmentAdapter : public InferenceBackend
+{
+public:
+    static constexpr int64_t segmentFrames = 512;
+    static constexpr int64_t modelBins = 2048;
+
+    explicit LarsNetSegmentAdapter(std::unique_ptr<InferenceBackend> core);
+
+    juce::String getName() const override { return core->getName(); }
+    torch::Tensor run(const torch::Tensor& input) const override;
+
+    /** [N, C, F, T] -> [N * ceil(T / 512), C, F, 512], zero padded at the end. */
+    static torch::Tensor foldSegments(const torch::Tensor& spec);
+
+    /** Inverse of foldSegments(), trimmed back to numFrames. */
+    static torch::Tensor unfoldSegments(const torch::Tensor& segments, int64_t batchSize, int64_t numFrames);
+
+private:
+    std::unique_ptr<InferenceBackend> core;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LarsNetSegmentAdapter)
+};
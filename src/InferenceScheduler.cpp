@@ -0,0 +1,247 @@
+#include "InferenceScheduler.h"
+#include "Timing.h"
+
+#include <ATen/Config.h>
+#include <ATen/Parallel.h>
+#include <atomic>
+#include <exception>
+
+
+static int resolveTotalThreads(int requested)
+{
+    if (requested > 0)
+        return requested;
+
+    return juce::jmax(1, juce::SystemStats::getNumPhysicalCpus());
+}
+
+static bool isThreadCountPerThread()
+{
+    // ATEN_THREADING picks the backend when libtorch is built, only OpenMP keeps the count per thread
+   #if AT_PARALLEL_OPENMP
+    return true;
+   #else
+    return false;
+   #endif
+}
+
+InferenceScheduler::InferenceScheduler(int numThreads)
+    : totalThreads(resolveTotalThreads(numThreads)),
+      perThreadBudgets(isThreadCountPerThread()),
+      workers(ModelSession::numStems),
+      freeThreads(totalThreads)
+{
+    if (!perThreadBudgets)
+        DBG("InferenceScheduler: thread counts aren't per thread with this libtorch, running jobs one at a time\n"
+            << at::get_parallel_info());
+}
+
+void InferenceScheduler::setThreadBudget(int numThreads) const
+{
+    if (perThreadBudgets)
+        at::set_num_threads(numThreads);
+}
+
+InferenceScheduler::~InferenceScheduler()
+{
+    workers.removeAllJobs(true, -1);
+}
+
+InferenceScheduler::Reservation::Reservation(InferenceScheduler& o, int requested)
+    : numThreads(0), owner(o)
+{
+    std::unique_lock<std::mutex> lock(owner.budgetMutex);
+
+    // the live threads can be set aside while this waits, so the size is settled once it can start
+    owner.budgetReleased.wait(lock, [this, requested]
+    {
+        const int available = juce::jmax(1, owner.totalThreads - owner.liveThreads);
+        numThreads = owner.perThreadBudgets ? juce::jlimit(1, available, requested) : available;
+        return owner.freeThreads >= numThreads;
+    });
+
+    owner.freeThreads -= numThreads;
+}
+
+InferenceScheduler::Reservation::~Reservation()
+{
+    {
+        std::lock_guard<std::mutex> lock(owner.budgetMutex);
+        owner.freeThreads += numThreads;
+    }
+
+    owner.budgetReleased.notify_all();
+}
+
+int InferenceScheduler::reserveLiveThreads(int numThreads)
+{
+    const int reserved = juce::jlimit(1, totalThreads, numThreads > 0 ? numThreads : totalThreads / 2);
+
+    // taken at once, a running offline job can leave freeThreads below zero until it returns them
+    std::lock_guard<std::mutex> lock(budgetMutex);
+    liveThreads += reserved;
+    freeThreads -= reserved;
+    return reserved;
+}
+
+void InferenceScheduler::releaseLiveThreads(int numThreads)
+{
+    {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        liveThreads -= numThreads;
+        freeThreads += numThreads;
+    }
+
+    budgetReleased.notify_all();
+}
+
+InferenceScheduler::ThreadBudget InferenceScheduler::getBudget(int numJobs, int numThreads) const
+{
+    // every job runs alone with the whole budget
+    if (!perThreadBudgets)
+        return { 1, totalThreads };
+
+    const int threads = numThreads > 0 ? juce::jmin(numThreads, totalThreads) : totalThreads;
+
+    ThreadBudget budget;
+    budget.interOpThreads = juce::jlimit(1, threads, numJobs);
+    budget.intraOpThreadsPerJob = juce::jmax(1, threads / budget.interOpThreads);
+    return budget;
+}
+
+std::vector<torch::Tensor> InferenceScheduler::runStems(const ModelSession& session, const torch::Tensor& mag)
+{
+    return runStems(session, mag, totalThreads);
+}
+
+std::vector<torch::Tensor> InferenceScheduler::runStems(const ModelSession& session, const torch::Tensor& mag, int numThreads)
+{
+    const Reservation reservation(*this, numThreads);
+
+    // the fused ensemble is already one big grouped convolution per layer,
+    // it gets the reserved threads as intra-op threads. It only exists in float32.
+    if (session.isEnsembleLoaded() && session.getActivePrecision() == ModelSession::Precision::float32)
+    {
+        setThreadBudget(reservation.numThreads);
+        return session.inferEnsemble(mag);
+    }
+
+    return runStemsConcurrently(session, mag, reservation.numThreads);
+}
+
+std::vector<torch::Tensor> InferenceScheduler::runLiveStems(const ModelSession& session, const torch::Tensor& mag, int numThreads)
+{
+    jassert(numThreads > 0);
+
+    // the shared workers may be busy with an offline job, so nothing here queues on them
+    if (session.isEnsembleLoaded() && session.getActivePrecision() == ModelSession::Precision::float32)
+    {
+        setThreadBudget(numThreads);
+        return session.inferEnsemble(mag);
+    }
+
+    return runStemsSequentially(session, mag, numThreads);
+}
+
+torch::Tensor InferenceScheduler::runDemucs(const ModelSession& session, const torch::Tensor& audio)
+{
+    return runDemucs(session, audio, totalThreads);
+}
+
+torch::Tensor InferenceScheduler::runDemucs(const ModelSession& session, const torch::Tensor& audio, int numThreads)
+{
+    const Reservation reservation(*this, numThreads);
+
+    setThreadBudget(reservation.numThreads);
+    return session.inferDemucs(audio);
+}
+
+std::vector<torch::Tensor> InferenceScheduler::runStemsConcurrently(const ModelSession& session, const torch::Tensor& mag, int numThreads)
+{
+    if (!perThreadBudgets)
+        return runStemsSequentially(session, mag);
+
+    const ThreadBudget budget = getBudget(ModelSession::numStems, numThreads);
+
+    std::vector<torch::Tensor> outputs(ModelSession::numStems);
+    std::vector<std::exception_ptr> errors(ModelSession::numStems);
+    juce::WaitableEvent done;
+    std::atomic<int> remaining{ ModelSession::numStems };
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        workers.addJob([&, i]
+        {
+            // with the OpenMP backend the thread count is per calling thread,
+            // so every worker only ever uses its own slice of the cores
+            setThreadBudget(budget.intraOpThreadsPerJob);
+
+            try {
+                outputs[i] = session.inferStem(static_cast<ModelSession::Stem>(i), mag);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+
+            if (--remaining == 0)
+                done.signal();
+        });
+    }
+
+    done.wait();
+
+    for (auto& error : errors)
+        if (error != nullptr)
+            std::rethrow_exception(error);
+
+    return outputs;
+}
+
+std::vector<torch::Tensor> InferenceScheduler::runStemsSequentially(const ModelSession& session, const torch::Tensor& mag, int numThreads)
+{
+    setThreadBudget(numThreads > 0 ? juce::jmin(numThreads, totalThreads) : totalThreads);
+
+    std::vector<torch::Tensor> outputs;
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        outputs.push_back(session.inferStem(static_cast<ModelSession::Stem>(i), mag));
+
+    return outputs;
+}
+
+InferenceScheduler::SpeedupReport InferenceScheduler::measureSpeedup(const ModelSession& session, const torch::Tensor& mag, int numRuns)
+{
+    // one untimed pass of each so neither side pays for JIT profiling
+    runStemsSequentially(session, mag);
+    runStemsConcurrently(session, mag);
+
+    SpeedupReport report;
+    report.budget = getBudget(ModelSession::numStems);
+    report.sequentialMs = timeBestOf(numRuns, [&] { runStemsSequentially(session, mag); });
+    report.concurrentMs = timeBestOf(numRuns, [&] { runStemsConcurrently(session, mag); });
+
+    DBG("sequential: " << report.sequentialMs << " ms, concurrent (" << report.budget.interOpThreads << " x "
+        << report.budget.intraOpThreadsPerJob << " threads): " << report.concurrentMs << " ms, speedup "
+        << report.getSpeedup() << "x");
+
+    return report;
+}
+
+InferenceScheduler::SpeedupReport InferenceScheduler::measureEnsembleSpeedup(const ModelSession& session, const torch::Tensor& mag, int numRuns)
+{
+    SpeedupReport report;
+    report.budget = getBudget(1);
+
+    if (!session.isEnsembleLoaded())
+        return report;
+
+    runStemsSequentially(session, mag);
+    session.inferEnsemble(mag);
+
+    report.sequentialMs = timeBestOf(numRuns, [&] { runStemsSequentially(session, mag); });
+    report.concurrentMs = timeBestOf(numRuns, [&] { setThreadBudget(totalThreads); session.inferEnsemble(mag); });
+
+    DBG("separate stem models: " << report.sequentialMs << " ms, fused ensemble: " << report.concurrentMs
+        << " ms, speedup " << report.getSpeedup() << "x");
+
+    return report;
+}
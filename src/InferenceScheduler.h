@@ -0,0 +1,129 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "ModelSession.h"
+
+
+//==============================================================================
+/**
+    Runs the five LarsNet stem models concurrently instead of one after the
+    other. Batch-1 convolutions don't scale well with intra-op threads alone,
+    so the core budget is split: one worker per stem (inter-op), each with its
+    own share of the cores for the convolution kernels (intra-op).
+
+    One scheduler is shared by every plugin instance (see SharedInference).
+    Every job reserves its threads from the budget before it starts and waits
+    while they are taken. The plain calls reserve the whole budget, so jobs
+    from different instances run one at a time and never oversubscribe the
+    cores; the numThreads overloads let the stages of a SeparationEngine share
+    it and run side by side.
+
+    Live separation can't queue behind an offline job, so it sets threads of
+    its own aside with reserveLiveThreads() while live mode is on. Offline
+    reservations are clamped to what is left, they run slower but never hold
+    up a live hop; jobs already running keep their threads until they finish.
+
+    Splitting the cores relies on at::set_num_threads() applying to the calling
+    thread only, which is true of libtorch's OpenMP backend. With the native
+    thread pool it is one global setting, so the scheduler leaves it alone:
+    every job reserves the whole budget and the stems run one after the other
+    (see hasPerThreadBudgets()).
+*/
+class InferenceScheduler
+{
+public:
+    struct ThreadBudget
+    {
+        int interOpThreads;
+        int intraOpThreadsPerJob;
+    };
+
+    struct SpeedupReport
+    {
+        double sequentialMs{ 0.0 };
+        double concurrentMs{ 0.0 };
+        ThreadBudget budget{ 1, 1 };
+
+        double getSpeedup() const { return concurrentMs > 0.0 ? sequentialMs / concurrentMs : 0.0; }
+    };
+
+    /** totalThreads = 0 uses every physical core */
+    explicit InferenceScheduler(int totalThreads = 0);
+    ~InferenceScheduler();
+
+    /** Split numThreads (0 = the whole budget) between numJobs concurrent jobs. */
+    ThreadBudget getBudget(int numJobs, int numThreads = 0) const;
+    int getTotalThreads() const { return totalThreads; }
+
+    /** True if libtorch keeps a thread count per calling thread, so jobs can run side by side. */
+    bool hasPerThreadBudgets() const { return perThreadBudgets; }
+
+    /** Run every stem with the fastest path available: the fused ensemble if it is
+        loaded and the session runs in float32, otherwise the stem models concurrently. Outputs are in ModelSession::Stem order. */
+    std::vector<torch::Tensor> runStems(const ModelSession& session, const torch::Tensor& mag);
+
+    /** Same, with only numThreads of the budget, waiting until they are free. */
+    std::vector<torch::Tensor> runStems(const ModelSession& session, const torch::Tensor& mag, int numThreads);
+
+    /** Set aside numThreads for runLiveStems() and return how many were taken, half the budget by default.
+        Offline jobs get the rest until releaseLiveThreads(). */
+    int reserveLiveThreads(int numThreads = 0);
+    void releaseLiveThreads(int numThreads);
+
+    /** runStems() on threads set aside by reserveLiveThreads(), never waiting for offline jobs. The stems
+        run on the calling thread rather than the shared workers, the ensemble if it is available. */
+    std::vector<torch::Tensor> runLiveStems(const ModelSession& session, const torch::Tensor& mag, int numThreads);
+
+    /** Run one HTDemucs window with the whole budget, queued behind the other instances' jobs. */
+    torch::Tensor runDemucs(const ModelSession& session, const torch::Tensor& audio);
+
+    /** Same, with only numThreads of the budget, waiting until they are free. */
+    torch::Tensor runDemucs(const ModelSession& session, const torch::Tensor& audio, int numThreads);
+
+    /** One worker per stem model, each with its slice of numThreads (0 = the whole budget).
+        Without per-thread budgets it runs them sequentially instead. */
+    std::vector<torch::Tensor> runStemsConcurrently(const ModelSession& session, const torch::Tensor& mag, int numThreads = 0);
+
+    /** The old path: one stem after the other, each using numThreads (0 = the whole budget). */
+    std::vector<torch::Tensor> runStemsSequentially(const ModelSession& session, const torch::Tensor& mag, int numThreads = 0);
+
+    /** Time the sequential and the concurrent paths on the same input (best of numRuns). */
+    SpeedupReport measureSpeedup(const ModelSession& session, const torch::Tensor& mag, int numRuns = 3);
+
+    /** Time the five separate stem models against one forward of the fused ensemble. */
+    SpeedupReport measureEnsembleSpeedup(const ModelSession& session, const torch::Tensor& mag, int numRuns = 3);
+
+private:
+    /** at::set_num_threads() for the calling thread, skipped where it isn't per thread. */
+    void setThreadBudget(int numThreads) const;
+
+    /** Holds numThreads of the budget outside the live threads for its lifetime, blocking until they are free. */
+    class Reservation
+    {
+    public:
+        Reservation(InferenceScheduler& owner, int numThreads);
+        ~Reservation();
+
+        int numThreads;
+
+    private:
+        InferenceScheduler& owner;
+    };
+
+    int totalThreads;
+    bool perThreadBudgets;
+    juce::ThreadPool workers;
+
+    // threads of the budget not reserved by a running job or set aside for live separation
+    std::mutex budgetMutex;
+    std::condition_variable budgetReleased;
+    int freeThreads;
+    int liveThreads{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InferenceScheduler)
+};
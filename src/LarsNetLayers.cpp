@@ -0,0 +1,128 @@
+#include "LarsNetLayers.h"
+
+#include <chrono>
+
+
+LarsNetLayerBackend::LarsNetLayerBackend(const torch::jit::script::Module& unet, Layout l)
+    : module(unet.clone()), layout(l)
+{
+    module.eval();
+
+    torch::NoGradGuard noGrad;
+
+    if (layout == Layout::channelsLast)
+    {
+        for (const auto& parameter : module.named_parameters(true))
+            if (parameter.value.dim() == 4)
+                parameter.value.set_data(parameter.value.contiguous(at::MemoryFormat::ChannelsLast));
+    }
+
+    // eval-mode BatchNorm over F: y = x * weight / sqrt(var + eps) + (bias - mean * weight / sqrt(var + eps))
+    torch::jit::script::Module inputNorm = module.attr("input_norm").toModule();
+    const torch::Tensor weight = inputNorm.attr("weight").toTensor();
+    const torch::Tensor bias = inputNorm.attr("bias").toTensor();
+    const torch::Tensor mean = inputNorm.attr("running_mean").toTensor();
+    const torch::Tensor var = inputNorm.attr("running_var").toTensor();
+    const double eps = inputNorm.attr("eps").toDouble();
+
+    const torch::Tensor scale = weight / torch::sqrt(var + eps);
+    inputScale = scale.view({ 1, 1, -1, 1 }).clone();
+    inputShift = (bias - mean * scale).view({ 1, 1, -1, 1 }).clone();
+
+    power = module.attr("power").toDouble();
+
+    for (size_t i = 0; i < encoders.size(); ++i)
+    {
+        encoders[i] = module.attr("enc" + std::to_string(i + 1)).toModule();
+        decoders[i] = module.attr("dec" + std::to_string(i + 1)).toModule();
+    }
+
+    maskLayer = module.attr("mask_layer").toModule();
+}
+
+juce::String LarsNetLayerBackend::getName() const
+{
+    return "torchjit-layers-" + getLayoutName(layout);
+}
+
+juce::String LarsNetLayerBackend::getLayoutName(Layout l)
+{
+    return l == Layout::channelsLast ? "channels-last" : "nchw";
+}
+
+torch::Tensor LarsNetLayerBackend::run(const torch::Tensor& segments) const
+{
+    return runLayers(segments, nullptr);
+}
+
+torch::Tensor LarsNetLayerBackend::runTimed(const torch::Tensor& segments, std::vector<LayerTiming>& timings) const
+{
+    return runLayers(segments, &timings);
+}
+
+torch::Tensor LarsNetLayerBackend::runLayers(const torch::Tensor& segments, std::vector<LayerTiming>* timings) const
+{
+    c10::InferenceMode guard;
+
+    auto start = std::chrono::steady_clock::now();
+    auto lap = [&](const char* name)
+    {
+        if (timings == nullptr)
+            return;
+
+        const auto now = std::chrono::steady_clock::now();
+        timings->push_back({ name, std::chrono::duration<double, std::milli>(now - start).count() });
+        start = now;
+    };
+
+    auto encode = [](torch::jit::script::Module m, const torch::Tensor& x)
+    {
+        const auto outputs = m.forward({ x }).toTuple();
+        return std::make_pair(outputs->elements()[0].toTensor(), outputs->elements()[1].toTensor());
+    };
+
+    auto decode = [](torch::jit::script::Module m, const torch::Tensor& x)
+    {
+        return m.forward({ x }).toTensor();
+    };
+
+    // Frontend
+    torch::Tensor x = segments;
+    if (layout == Layout::channelsLast)
+        x = x.contiguous(at::MemoryFormat::ChannelsLast);
+
+    x = x * inputScale + inputShift;
+    lap("input_norm");
+
+    // Encoder
+    static const char* encoderNames[] = { "enc1", "enc2", "enc3", "enc4", "enc5", "enc6" };
+    std::array<torch::Tensor, 6> skips;
+    torch::Tensor d = x;
+
+    for (size_t i = 0; i < encoders.size(); ++i)
+    {
+        std::tie(d, skips[i]) = encode(encoders[i], d);
+        lap(encoderNames[i]);
+    }
+
+    // Decoder
+    static const char* decoderNames[] = { "dec1", "dec2", "dec3", "dec4", "dec5", "dec6" };
+    torch::Tensor u = decode(decoders[0], skips[5]);
+    lap(decoderNames[0]);
+
+    for (size_t i = 1; i < decoders.size(); ++i)
+    {
+        u = decode(decoders[i], torch::cat({ skips[5 - i], u }, 1));
+        lap(decoderNames[i]);
+    }
+
+    // Masking
+    torch::Tensor mask = decode(maskLayer, u);
+    if (power != 1.0)
+        mask = mask.pow(power);
+
+    mask = mask.contiguous();
+    lap("mask_layer");
+
+    return mask;
+}
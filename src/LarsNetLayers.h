@@ -0,0 +1,66 @@
+#pragma once
+
+#include "InferenceBackend.h"
+
+#include <array>
+#include <vector>
+
+
+//==============================================================================
+/**
+    Runs UNet.forward_impl of a scripted LarsNet model one layer at a time
+    (input_norm, enc1..enc6, dec1..dec6, mask_layer): trimmed [S, 2, 2048, 512]
+    segments in, masks out. Wrap it in a LarsNetSegmentAdapter for the full
+    model interface.
+
+    The input BatchNorm over the frequency axis is applied as a broadcast
+    scale and shift, so the N x F x C x T transposes around it disappear.
+    With Layout::channelsLast every 4-D weight is converted once to
+    channels-last at construction and the activations are converted once on
+    the way in; conv, BatchNorm, activations and cat all preserve the format,
+    so nothing is reordered again until the mask is returned.
+
+    Running layer by layer is also what makes per-layer timing possible.
+*/
+class LarsNetLayerBackend : public InferenceBackend
+{
+public:
+    enum class Layout
+    {
+        contiguous,
+        channelsLast
+    };
+
+    struct LayerTiming
+    {
+        juce::String name;
+        double ms{ 0.0 };
+    };
+
+    /** unet must be a scripted, not frozen, LarsNet UNet. It is cloned. */
+    LarsNetLayerBackend(const torch::jit::script::Module& unet, Layout layout);
+
+    juce::String getName() const override;
+    torch::Tensor run(const torch::Tensor& segments) const override;
+
+    /** Same as run(), with the wall time of every layer appended to timings. */
+    torch::Tensor runTimed(const torch::Tensor& segments, std::vector<LayerTiming>& timings) const;
+
+    static juce::String getLayoutName(Layout layout);
+
+private:
+    torch::Tensor runLayers(const torch::Tensor& segments, std::vector<LayerTiming>* timings) const;
+
+    torch::jit::script::Module module;
+    Layout layout;
+
+    torch::Tensor inputScale;
+    torch::Tensor inputShift;
+    double power{ 1.0 };
+
+    std::array<torch::jit::script::Module, 6> encoders;
+    std::array<torch::jit::script::Module, 6> decoders;
+    torch::jit::script::Module maskLayer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LarsNetLayerBackend)
+};
@@ -0,0 +1,360 @@
+#include "LiveSeparator.h"
+#include "StreamingSeparator.h"
+#include "Timing.h"
+
+#include <cmath>
+
+
+LiveSeparator::LiveSeparator(const ModelSession& s, InferenceScheduler& sched)
+    : juce::Thread("Live Separation Thread"), session(s), scheduler(sched),
+      stftEngine(StftEngine::get(nFft, hopLength))
+{
+    for (auto& enabled : stemEnabled)
+        enabled = true;
+}
+
+LiveSeparator::~LiveSeparator()
+{
+    release();
+}
+
+void LiveSeparator::prepare(int maxBlockSize, double sampleRate)
+{
+    release();
+
+    inputResampler.reset();
+    for (auto& resampler : outputResamplers)
+        resampler.reset();
+
+    // the FIFOs run at the host rate, everything below is counted in it
+    const double ratio = sampleRate / ModelSession::sampleRate;
+    auto toHostRate = [ratio](int samples) { return static_cast<int>(std::ceil(samples * ratio)); };
+    int resamplerDelay = 0;
+
+    if (std::llround(sampleRate) != std::llround(ModelSession::sampleRate))
+    {
+        inputResampler = std::make_unique<PolyphaseResampler>(sampleRate, ModelSession::sampleRate);
+        for (auto& resampler : outputResamplers)
+            resampler = std::make_unique<PolyphaseResampler>(ModelSession::sampleRate, sampleRate);
+
+        // each filter holds back half its taps of future, at the lower of the two rates
+        const int halfTaps = inputResampler->getTapsPerPhase() / 2;
+        resamplerDelay = 2 * halfTaps * static_cast<int>(std::ceil(juce::jmax(1.0, ratio))) + 2;
+    }
+
+    maxHopOutput = inputResampler != nullptr ? toHostRate(hopSamples) + 1 : hopSamples;
+
+    // a sample enters the window at its newest end and leaves the synthesis
+    // once lookaheadFrames frames are past it; on top of that the models get
+    // one hop to run and the audio thread one block of slack
+    const int algorithmicDelay = (hopFrames + lookaheadFrames - 1) * hopLength + nFft;
+    latencySamples = toHostRate(algorithmicDelay + hopSamples) + resamplerDelay + maxBlockSize;
+
+    const int inputCapacity = toHostRate(historySamples + 4 * hopSamples) + maxBlockSize;
+    inputFifo.setTotalSize(inputCapacity);
+    inputRing.setSize(2, inputCapacity);
+
+    const int outputCapacity = latencySamples + toHostRate(4 * hopSamples);
+    outputFifo.setTotalSize(outputCapacity);
+    for (auto& ring : outputRings)
+        ring.setSize(2, outputCapacity);
+
+    // the first hop comes out for the input sample hopSamples - algorithmicDelay,
+    // the silence in front of it makes that sample play latencySamples late
+    primedSamples = latencySamples - static_cast<int>(std::lround((algorithmicDelay - hopSamples) * ratio));
+
+    {
+        c10::InferenceMode guard(true);
+
+        window = stftEngine.getWindow();
+
+        // every output sample is covered by nFft / hopLength frames, the envelope repeats every hop
+        squaredWindowSum = window.pow(2).reshape({ nFft / hopLength, hopLength }).sum(0).repeat({ hopFrames });
+    }
+
+    prepared = true;
+    reset();
+}
+
+void LiveSeparator::reset()
+{
+    jassert(!isThreadRunning());
+
+    if (!prepared)
+        return;
+
+    inputFifo.reset();
+    inputRing.clear();
+
+    outputFifo.reset();
+    for (auto& ring : outputRings)
+        ring.clear();
+
+    int start1, size1, start2, size2;
+    outputFifo.prepareToWrite(primedSamples, start1, size1, start2, size2);
+    outputFifo.finishedWrite(size1 + size2);
+
+    if (inputResampler != nullptr)
+        inputResampler->reset();
+
+    for (auto& resampler : outputResamplers)
+        if (resampler != nullptr)
+            resampler->reset();
+
+    {
+        c10::InferenceMode guard(true);
+
+        const int numBins = nFft / 2 + 1;
+        history = torch::zeros({ 2, historySamples });
+        magnitudes = torch::zeros({ 2, numBins, windowFrames });
+        recentSpec = torch::zeros({ 2, numBins, hopFrames + lookaheadFrames }, torch::kComplexFloat);
+        hopInput = torch::zeros({ 2, hopSamples });
+        modelRateInput = torch::zeros({ 2, 0 });
+
+        for (auto& carry : carries)
+            carry = torch::zeros({ 2, nFft - hopLength });
+    }
+
+    numUnderruns = 0;
+    pendingSkip = 0;
+}
+
+void LiveSeparator::start()
+{
+    if (!prepared || isThreadRunning())
+        return;
+
+    liveThreads = scheduler.reserveLiveThreads();
+    startThread();
+}
+
+void LiveSeparator::release()
+{
+    stopThread(2000);
+
+    if (liveThreads > 0)
+        scheduler.releaseLiveThreads(liveThreads);
+
+    liveThreads = 0;
+}
+
+double LiveSeparator::measureHopMs(int numRuns)
+{
+    jassert(prepared && !isThreadRunning());
+
+    liveThreads = scheduler.reserveLiveThreads();
+
+    const double hopMs = timeBestOf(numRuns, [this]
+    {
+        {
+            c10::InferenceMode guard(true);
+            hopInput = torch::rand({ 2, hopSamples }) * 2 - 1;
+        }
+
+        separateHop();
+    });
+
+    release();
+    reset();
+    return hopMs;
+}
+
+void LiveSeparator::pushInput(const juce::AudioBuffer<float>& buffer, int numInputChannels)
+{
+    const int numSamples = buffer.getNumSamples();
+
+    // whatever doesn't fit is dropped, the output side catches up with the skip below
+    int start1, size1, start2, size2;
+    inputFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        if (numInputChannels == 0)
+        {
+            inputRing.clear(ch, start1, size1);
+            inputRing.clear(ch, start2, size2);
+            continue;
+        }
+
+        const int source = juce::jmin(ch, numInputChannels - 1);
+
+        if (size1 > 0)
+            inputRing.copyFrom(ch, start1, buffer, source, 0, size1);
+        if (size2 > 0)
+            inputRing.copyFrom(ch, start2, buffer, source, size1, size2);
+    }
+
+    inputFifo.finishedWrite(size1 + size2);
+
+    // wakes the background thread, it sleeps until there's input
+    notify();
+}
+
+void LiveSeparator::popOutput(juce::AudioBuffer<float>& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    buffer.clear();
+
+    // samples that missed their slot are thrown away so the latency stays put
+    if (pendingSkip > 0)
+    {
+        const int skip = juce::jmin(pendingSkip, outputFifo.getNumReady());
+        int start1, size1, start2, size2;
+        outputFifo.prepareToRead(skip, start1, size1, start2, size2);
+        outputFifo.finishedRead(size1 + size2);
+        pendingSkip -= size1 + size2;
+    }
+
+    int start1, size1, start2, size2;
+    outputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        if (!stemEnabled[i].load())
+            continue;
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            const int source = juce::jmin(ch, 1);
+
+            if (size1 > 0)
+                buffer.addFrom(ch, 0, outputRings[i], source, start1, size1);
+            if (size2 > 0)
+                buffer.addFrom(ch, size1, outputRings[i], source, start2, size2);
+        }
+    }
+
+    outputFifo.finishedRead(size1 + size2);
+
+    if (size1 + size2 < numSamples)
+    {
+        pendingSkip += numSamples - (size1 + size2);
+        ++numUnderruns;
+    }
+}
+
+void LiveSeparator::run()
+{
+    while (!threadShouldExit())
+    {
+        if (outputFifo.getFreeSpace() >= maxHopOutput && readHop())
+            separateHop();
+        else
+            wait(-1);
+    }
+}
+
+bool LiveSeparator::readHop()
+{
+    if (inputResampler == nullptr)
+    {
+        if (inputFifo.getNumReady() < hopSamples)
+            return false;
+
+        readInput(hopInput, hopSamples);
+        return true;
+    }
+
+    c10::InferenceMode guard(true);
+
+    // whatever the host delivered so far is resampled, the rest of a hop waits for the next round
+    while (modelRateInput.size(1) < hopSamples)
+    {
+        const int ready = inputFifo.getNumReady();
+        if (ready == 0)
+            return false;
+
+        torch::Tensor chunk = torch::empty({ 2, ready });
+        readInput(chunk, ready);
+        modelRateInput = torch::cat({ modelRateInput, inputResampler->process(chunk) }, 1);
+    }
+
+    hopInput.copy_(modelRateInput.narrow(1, 0, hopSamples));
+    modelRateInput = modelRateInput.narrow(1, hopSamples, modelRateInput.size(1) - hopSamples);
+    return true;
+}
+
+void LiveSeparator::readInput(torch::Tensor& dest, int numSamples)
+{
+    int start1, size1, start2, size2;
+    inputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        float* samples = dest[ch].data_ptr<float>();
+        juce::FloatVectorOperations::copy(samples, inputRing.getReadPointer(ch, start1), size1);
+        juce::FloatVectorOperations::copy(samples + size1, inputRing.getReadPointer(ch, start2), size2);
+    }
+
+    inputFifo.finishedRead(size1 + size2);
+}
+
+void LiveSeparator::separateHop()
+{
+    c10::InferenceMode guard(true);
+
+    // the frames before the newest hopFrames were transformed by earlier hops
+    history = torch::cat({ history.narrow(1, hopSamples, historySamples - hopSamples), hopInput }, 1);
+
+    const torch::Tensor spec = stftEngine.stft(history, false, false);
+    magnitudes = torch::cat({ magnitudes.narrow(2, hopFrames, windowFrames - hopFrames), torch::abs(spec) }, 2);
+    recentSpec = torch::cat({ recentSpec.narrow(2, hopFrames, lookaheadFrames), spec }, 2);
+
+    // only the hop's frames are resynthesized
+    const StftEngine::Mixture mixture = stftEngine.prepareMixture(recentSpec.narrow(2, 0, hopFrames),
+                                                                  magnitudes.narrow(2, contextFrames, hopFrames));
+
+    std::vector<torch::Tensor> outputs;
+    try
+    {
+        outputs = scheduler.runLiveStems(session, magnitudes.unsqueeze(0), liveThreads);
+    }
+    catch (const std::exception& e)
+    {
+        DBG("Live separation failed: " << e.what());
+    }
+
+    // the frames with contextFrames of past and lookaheadFrames of future around them, all stems in one batch
+    torch::Tensor stemFrames;
+    if (!outputs.empty())
+    {
+        std::vector<torch::Tensor> stemMags;
+        for (const torch::Tensor& output : outputs)
+            stemMags.push_back(output.squeeze(0).narrow(2, contextFrames, hopFrames));
+
+        stemFrames = stftEngine.inverseFramesMasked(mixture, stemMags);
+    }
+
+    std::array<torch::Tensor, ModelSession::numStems> hopOutputs;
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        torch::Tensor acc = torch::zeros({ 2, hopSamples + nFft - hopLength });
+        acc.narrow(1, 0, nFft - hopLength).add_(carries[i]);
+
+        if (stemFrames.defined())
+            StreamingSeparator::overlapAddFrames(acc, stemFrames.narrow(0, 2 * i, 2), nFft, hopLength);
+
+        carries[i] = acc.narrow(1, hopSamples, nFft - hopLength).clone();
+        hopOutputs[i] = (acc.narrow(1, 0, hopSamples) / squaredWindowSum).contiguous();
+
+        if (outputResamplers[i] != nullptr)
+            hopOutputs[i] = outputResamplers[i]->process(hopOutputs[i]);
+    }
+
+    // every stem's resampler has seen the same number of samples, so they all return as many
+    int start1, size1, start2, size2;
+    outputFifo.prepareToWrite(static_cast<int>(hopOutputs[0].size(1)), start1, size1, start2, size2);
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            const float* source = hopOutputs[i][ch].data_ptr<float>();
+            outputRings[i].copyFrom(ch, start1, source, size1);
+            outputRings[i].copyFrom(ch, start2, source + size1, size2);
+        }
+    }
+
+    outputFifo.finishedWrite(size1 + size2);
+}
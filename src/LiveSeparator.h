@@ -0,0 +1,138 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+#include "InferenceBackend.h"
+#include "StftEngine.h"
+#include "PolyphaseResampler.h"
+
+
+//==============================================================================
+/**
+    Real-time LarsNet separation for the live mode of the processor.
+
+    The audio thread only copies samples in and out of lock-free FIFOs
+    (pushInput() / popOutput()). A background thread keeps a sliding window of
+    one model segment (512 STFT frames) over the input, only the hopFrames
+    newest frames are transformed each hop. Every hopFrames frames it runs the
+    stem models on that window and keeps the hopFrames frames that have
+    contextFrames of past and lookaheadFrames of future around them. The models
+    pad shorter inputs to a whole segment anyway, so the long context costs no
+    more than a short one. Those frames sit on one global STFT grid and are
+    overlap-added with the synthesis window, so consecutive hops join as
+    smoothly as in the offline iSTFT.
+
+    The output is delayed by a fixed getLatencySamples(): the algorithmic delay
+    of the window plus one hop of compute budget and one audio block. If the
+    models fall behind, the missing samples come out as silence and are counted
+    in getNumUnderruns(). measureHopMs() tells whether the models keep up:
+    one hop has to take less than getHopMs().
+
+    The models expect 44.1 kHz. At any other host rate the background thread
+    resamples the input to it and the stems back with PolyphaseResamplers, the
+    FIFOs stay at the host rate and the latency grows by the filter delays.
+*/
+class LiveSeparator : private juce::Thread
+{
+public:
+    LiveSeparator(const ModelSession& session, InferenceScheduler& scheduler);
+    ~LiveSeparator() override;
+
+    /** Allocate everything for this block size and host rate and reset(). Stops the background thread,
+        start() runs it. Not real-time safe. */
+    void prepare(int maxBlockSize, double sampleRate = ModelSession::sampleRate);
+
+    /** Forget all input, output and STFT state, the output starts again with getLatencySamples()
+        of silence. Only with the background thread stopped (release()) and the audio thread out of
+        pushInput() / popOutput(), e.g. under the processor's callback lock. Not real-time safe. */
+    void reset();
+
+    /** Start the background thread, once prepared, with its own threads of the scheduler's budget
+        (InferenceScheduler::reserveLiveThreads()), so hops never wait for offline jobs. It only runs
+        while live mode is on and sleeps until pushInput() wakes it. Not real-time safe. */
+    void start();
+
+    /** Stop the background thread and hand its threads back to the scheduler. Not real-time safe. */
+    void release();
+
+    /** Audio thread: queue the input channels (mono is used for both sides) and wake the background thread. */
+    void pushInput(const juce::AudioBuffer<float>& buffer, int numInputChannels);
+
+    /** Audio thread: overwrite buffer with the enabled stems, summed, getLatencySamples() late. */
+    void popOutput(juce::AudioBuffer<float>& buffer);
+
+    void setStemEnabled(ModelSession::Stem stem, bool enabled) { stemEnabled[stem] = enabled; }
+    bool isStemEnabled(ModelSession::Stem stem) const { return stemEnabled[stem].load(); }
+
+    int getLatencySamples() const { return latencySamples; }
+    int getNumUnderruns() const { return numUnderruns.load(); }
+
+    /** Separated samples waiting for popOutput(). */
+    int getNumOutputReady() const { return outputFifo.getNumReady(); }
+
+    /** Wall time of one hop in milliseconds, best of numRuns on noise, then reset(). Only with the
+        background thread stopped, for the benchmark. */
+    double measureHopMs(int numRuns = 3);
+
+    /** The audio one hop covers, the real-time limit for measureHopMs(). */
+    static double getHopMs() { return 1000.0 * hopSamples / ModelSession::sampleRate; }
+
+    static constexpr int nFft = 4096;
+    static constexpr int hopLength = 1024;
+    static constexpr int hopFrames = 8;
+    static constexpr int lookaheadFrames = 4;
+    static constexpr int contextFrames = static_cast<int>(LarsNetSegmentAdapter::segmentFrames) - hopFrames - lookaheadFrames;
+
+private:
+    void run() override;
+
+    /** Fill hopInput with the next hop at 44.1 kHz, false until there's enough input. */
+    bool readHop();
+    void readInput(torch::Tensor& dest, int numSamples);
+    void separateHop();
+
+    static constexpr int windowFrames = contextFrames + hopFrames + lookaheadFrames;
+    static constexpr int hopSamples = hopFrames * hopLength;
+    static constexpr int historySamples = (hopFrames - 1) * hopLength + nFft; // input of the hop's newest frames
+
+    const ModelSession& session;
+    InferenceScheduler& scheduler;
+    const StftEngine& stftEngine;
+
+    // audio thread -> background thread
+    juce::AbstractFifo inputFifo{ 1 };
+    juce::AudioBuffer<float> inputRing;
+
+    // background thread -> audio thread, one ring per stem sharing one fifo
+    juce::AbstractFifo outputFifo{ 1 };
+    std::array<juce::AudioBuffer<float>, ModelSession::numStems> outputRings;
+
+    // background thread only
+    torch::Tensor window, squaredWindowSum, history, hopInput;
+    torch::Tensor magnitudes; // [2, bins, windowFrames], the models' input
+    torch::Tensor recentSpec; // [2, bins, hopFrames + lookaheadFrames], the newest complex frames
+    std::array<torch::Tensor, ModelSession::numStems> carries;
+
+    // only when the host doesn't run at 44.1 kHz, background thread only
+    std::unique_ptr<PolyphaseResampler> inputResampler;
+    std::array<std::unique_ptr<PolyphaseResampler>, ModelSession::numStems> outputResamplers;
+    torch::Tensor modelRateInput;
+    int maxHopOutput{ hopSamples }; // host rate samples one hop can write
+
+    std::array<std::atomic<bool>, ModelSession::numStems> stemEnabled;
+    std::atomic<int> numUnderruns{ 0 };
+    int pendingSkip{ 0 }; // audio thread only
+    int latencySamples{ 0 };
+    int primedSamples{ 0 }; // silence queued in front of the first hop
+    bool prepared{ false };
+    int liveThreads{ 0 }; // set aside in the scheduler while the background thread runs
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LiveSeparator)
+};
@@ -0,0 +1,143 @@
+#include "ModelPack.h"
+
+#include <caffe2/serialize/read_adapter_interface.h>
+#include <cstring>
+#include <stdexcept>
+
+
+//==============================================================================
+/** Lets torch::jit::load read one pack entry straight out of the mapping. */
+class MappedEntryReader : public caffe2::serialize::ReadAdapterInterface
+{
+public:
+    MappedEntryReader(std::shared_ptr<juce::MemoryMappedFile> m, uint64_t offset, uint64_t size)
+        : mapping(std::move(m)),
+          data(static_cast<const char*>(mapping->getData()) + offset),
+          entrySize(size)
+    {
+    }
+
+    size_t size() const override
+    {
+        return static_cast<size_t>(entrySize);
+    }
+
+    size_t read(uint64_t pos, void* buf, size_t n, const char* what = "") const override
+    {
+        juce::ignoreUnused(what);
+
+        if (pos >= entrySize)
+            return 0;
+
+        const size_t count = static_cast<size_t>(std::min<uint64_t>(n, entrySize - pos));
+        std::memcpy(buf, data + pos, count);
+        return count;
+    }
+
+private:
+    std::shared_ptr<juce::MemoryMappedFile> mapping;    // keeps the pages mapped while the reader lives
+    const char* data;
+    uint64_t entrySize;
+};
+
+//==============================================================================
+ModelPack::ModelPack(const juce::File& f)
+    : file(f)
+{
+    if (!file.existsAsFile())
+        return;
+
+    mapping = std::make_shared<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+
+    if (mapping->getData() == nullptr || !readHeader())
+    {
+        DBG(file.getFullPathName() << " is not a version " << (int) formatVersion << " model pack");
+        mapping.reset();
+        entries.clear();
+    }
+}
+
+bool ModelPack::readHeader()
+{
+    const auto* bytes = static_cast<const char*>(mapping->getData());
+    const uint64_t fileSize = mapping->getSize();
+    const size_t headerSize = 16;
+    const size_t entrySize = nameLength + 16;
+
+    if (fileSize < headerSize || std::memcmp(bytes, "LARSPACK", 8) != 0)
+        return false;
+
+    if (juce::ByteOrder::littleEndianInt(bytes + 8) != formatVersion)
+        return false;
+
+    const uint32_t numEntries = juce::ByteOrder::littleEndianInt(bytes + 12);
+
+    if (fileSize < headerSize + (uint64_t) numEntries * entrySize)
+        return false;
+
+    for (uint32_t i = 0; i < numEntries; ++i)
+    {
+        const char* record = bytes + headerSize + i * entrySize;
+
+        const juce::String name(juce::CharPointer_UTF8(record), juce::CharPointer_UTF8(record + strnlen(record, nameLength)));
+        const Entry entry{ juce::ByteOrder::littleEndianInt64(record + nameLength),
+                           juce::ByteOrder::littleEndianInt64(record + nameLength + 8) };
+
+        if (entry.offset + entry.size > fileSize)
+            return false;
+
+        entries[name] = entry;
+    }
+
+    return true;
+}
+
+bool ModelPack::contains(const juce::String& name) const
+{
+    return entries.find(name) != entries.end();
+}
+
+juce::StringArray ModelPack::getEntryNames() const
+{
+    juce::StringArray names;
+    for (const auto& entry : entries)
+        names.add(entry.first);
+    return names;
+}
+
+torch::jit::script::Module ModelPack::loadModule(const juce::String& name) const
+{
+    const auto it = entries.find(name);
+
+    if (it == entries.end())
+        throw std::runtime_error(("no \"" + name + "\" in the model pack").toStdString());
+
+    auto reader = std::make_shared<MappedEntryReader>(mapping, it->second.offset, it->second.size);
+    torch::jit::script::Module module = torch::jit::load(std::move(reader));
+    module.eval();
+    return module;
+}
+
+juce::File ModelPack::findDefaultFile()
+{
+    const juce::String fromEnvironment = juce::SystemStats::getEnvironmentVariable("LARS_MODEL_PACK", {});
+    if (fromEnvironment.isNotEmpty())
+        return juce::File::getCurrentWorkingDirectory().getChildFile(fromEnvironment);
+
+    const juce::String packName = "LARS.modelpack";
+
+    // currentExecutableFile is the plugin binary itself when running inside a host
+    const juce::File binary = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+
+    const juce::File candidates[] = {
+        binary.getSiblingFile(packName),
+        binary.getParentDirectory().getSiblingFile("Resources").getChildFile(packName),    // macOS bundles
+        juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("LARS").getChildFile(packName)
+    };
+
+    for (const auto& candidate : candidates)
+        if (candidate.existsAsFile())
+            return candidate;
+
+    return candidates[0];
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/script.h>
+#include <map>
+#include <memory>
+
+
+//==============================================================================
+/**
+    A versioned pack of TorchScript models on disk, written by
+    net/make_model_pack.py. The file is memory-mapped read-only and each model
+    is deserialized straight from the mapping, so only the pages of the models
+    that are actually loaded are ever read, and there's no intermediate copy.
+
+    Layout (little endian):
+        char[8]   magic "LARSPACK"
+        uint32    format version
+        uint32    number of entries
+        entries:  char[64] name (zero padded), uint64 offset, uint64 size
+        payloads, each starting on a 4096-byte boundary
+
+    Entry names: "kick", "snare", "toms", "hihat", "cymbals", "<stem>_int8",
+    "ensemble" and "htdemucs".
+*/
+class ModelPack
+{
+public:
+    static constexpr uint32_t formatVersion = 1;
+    static constexpr int nameLength = 64;
+
+    /** Maps the file. isValid() is false if it's missing or not a pack of this version. */
+    explicit ModelPack(const juce::File& file);
+
+    bool isValid() const { return mapping != nullptr; }
+    const juce::File& getFile() const { return file; }
+
+    bool contains(const juce::String& name) const;
+    juce::StringArray getEntryNames() const;
+
+    /** Deserialize one entry. Throws std::runtime_error for unknown entries. */
+    torch::jit::script::Module loadModule(const juce::String& name) const;
+
+    /** LARS_MODEL_PACK if set, otherwise the first LARS.modelpack found next to
+        the plugin binary, in its bundle's Resources folder or in the user's
+        application data folder. */
+    static juce::File findDefaultFile();
+
+private:
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    bool readHeader();
+
+    juce::File file;
+    std::shared_ptr<juce::MemoryMappedFile> mapping;
+    std::map<juce::String, Entry> entries;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ModelPack)
+};
@@ -0,0 +1,525 @@
+#include "ModelSession.h"
+#include "CpuFeatures.h"
+#include "OnnxRuntimeBackend.h"
+#include "AotInductorBackend.h"
+#include "LarsNetLayers.h"
+#include "Timing.h"
+
+#include <torch/csrc/jit/runtime/profiling_graph_executor_impl.h>
+#include <torch/version.h>
+#include <ATen/autocast_mode.h>
+#include <stdexcept>
+
+
+//==============================================================================
+/** Turns on CPU autocast to bfloat16 for the current thread. Convolutions and
+    matmuls run in bfloat16, ops on the fp32 list (stft, norms, softmax) stay float32. */
+class CpuAutocastGuard
+{
+public:
+    CpuAutocastGuard()
+    {
+       #if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 4)
+        wasEnabled = at::autocast::is_autocast_enabled(at::kCPU);
+        previousType = at::autocast::get_autocast_dtype(at::kCPU);
+        at::autocast::set_autocast_dtype(at::kCPU, at::kBFloat16);
+        at::autocast::set_autocast_enabled(at::kCPU, true);
+       #else
+        wasEnabled = at::autocast::is_cpu_enabled();
+        previousType = at::autocast::get_autocast_cpu_dtype();
+        at::autocast::set_autocast_cpu_dtype(at::kBFloat16);
+        at::autocast::set_cpu_enabled(true);
+       #endif
+    }
+
+    ~CpuAutocastGuard()
+    {
+       #if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 4)
+        at::autocast::set_autocast_enabled(at::kCPU, wasEnabled);
+        at::autocast::set_autocast_dtype(at::kCPU, previousType);
+       #else
+        at::autocast::set_cpu_enabled(wasEnabled);
+        at::autocast::set_autocast_cpu_dtype(previousType);
+       #endif
+        at::autocast::clear_cache();
+    }
+
+private:
+    bool wasEnabled;
+    at::ScalarType previousType;
+};
+
+//==============================================================================
+ModelSession::ModelSession()
+    : precision(getPrecisionFromEnvironment()),
+      backendConfig(BackendConfig::fromEnvironment()),
+      pack(std::make_unique<ModelPack>(ModelPack::findDefaultFile()))
+{
+}
+
+ModelSession::~ModelSession()
+{
+    // torch::jit::load can't be interrupted, so let a load in progress finish
+    loaderThread.stopThread(-1);
+}
+
+void ModelSession::startLoading()
+{
+    // only the caller that moves the state out of idle starts the loader
+    State expected = State::idle;
+    if (!state.compare_exchange_strong(expected, State::loading))
+        return;
+
+    sendChangeMessage();
+    loaderThread.startThread();
+}
+
+juce::String ModelSession::getLoadError() const
+{
+    return state.load() == State::failed ? loadError : juce::String();
+}
+
+void ModelSession::setState(State newState)
+{
+    state = newState;
+    sendChangeMessage();
+}
+
+void ModelSession::LoaderThread::run()
+{
+    session.loadModels();
+
+    if (threadShouldExit())
+        return;
+
+    if (!session.areStemModelsLoaded())
+    {
+        const juce::String packPath = session.pack->getFile().getFullPathName();
+        session.loadError = session.pack->isValid() ? "the LarsNet models couldn't be loaded from " + packPath
+                                                    : "no model pack at " + packPath + ", set LARS_MODEL_PACK";
+        session.setState(State::failed);
+        return;
+    }
+
+    try {
+        session.warmUp();
+    }
+    catch (const c10::Error& e) {
+        DBG("error warming up the LarsNet modules: " << e.what());
+    }
+
+    session.setState(State::ready);
+}
+
+torch::jit::script::Module ModelSession::loadStemModule(Stem stem, Precision p) const
+{
+    if (stem < 0 || stem >= numStems)
+        throw std::invalid_argument("unknown stem");
+
+    if (p == Precision::int8)
+        return pack->loadModule(getStemName(stem) + "_int8");
+
+    torch::jit::script::Module module = pack->loadModule(getStemName(stem));
+
+    if (p == Precision::bfloat16)
+        module.to(at::kBFloat16);
+
+    return module;
+}
+
+torch::jit::script::Module ModelSession::optimizeForInference(const torch::jit::script::Module& module)
+{
+    // freeze() inlines the weights as constants, drops the training-only
+    // branches (Dropout) and folds Conv->BatchNorm pairs wherever the conv
+    // output has no other use. optimize_for_inference() then runs the
+    // frozen-graph passes (oneDNN conversion, op fusion) on top of it.
+    torch::jit::script::Module copy = module.clone();
+    copy.eval();
+
+    torch::jit::script::Module frozen = torch::jit::freeze(copy);
+    return torch::jit::optimize_for_inference(frozen);
+}
+
+torch::jit::script::Module ModelSession::prepareModule(torch::jit::script::Module module) const
+{
+    if (!optimizeOnLoad)
+        return module;
+
+    try {
+        return optimizeForInference(module);
+    }
+    catch (const c10::Error& e) {
+        DBG("couldn't optimize the module, using it as scripted: " << e.what());
+    }
+
+    return module;
+}
+
+static void warmUpForTiming(const InferenceBackend& a, const InferenceBackend& b, const torch::Tensor& mag)
+{
+    // let the profiling executor specialize both graphs before timing
+    const int numWarmUpRuns = static_cast<int>(torch::jit::getNumProfiledRuns().load()) + 1;
+    for (int i = 0; i < numWarmUpRuns; ++i)
+    {
+        a.run(mag);
+        b.run(mag);
+    }
+}
+
+static at::ScalarType getComputeType(ModelSession::Precision p)
+{
+    // bfloat16 modules take bfloat16 inputs, the rest of the pipeline (STFT, iSTFT, masks) stays float32
+    return p == ModelSession::Precision::bfloat16 ? at::kBFloat16 : at::kFloat;
+}
+
+ModelSession::LatencyComparison ModelSession::compareOptimizedLatency(Stem stem, const torch::Tensor& mag, int numRuns) const
+{
+    const TorchJitBackend scripted(loadStemModule(stem));
+    const TorchJitBackend optimized(optimizeForInference(scripted.getModule()));
+
+    warmUpForTiming(scripted, optimized, mag);
+
+    LatencyComparison comparison;
+    comparison.scriptedMs = timeBestOf(numRuns, [&] { scripted.run(mag); });
+    comparison.optimizedMs = timeBestOf(numRuns, [&] { optimized.run(mag); });
+
+    DBG(getStemName(stem) << " scripted: " << comparison.scriptedMs << " ms, frozen + optimized: "
+        << comparison.optimizedMs << " ms, speedup " << comparison.getSpeedup() << "x");
+
+    return comparison;
+}
+
+ModelSession::PrecisionComparison ModelSession::comparePrecisionLatency(Stem stem, Precision reduced, const torch::Tensor& mag, int numRuns) const
+{
+    const TorchJitBackend float32Backend(optimizeForInference(loadStemModule(stem)));
+    const TorchJitBackend reducedBackend(optimizeForInference(loadStemModule(stem, reduced)), getComputeType(reduced));
+
+    warmUpForTiming(float32Backend, reducedBackend, mag);
+
+    PrecisionComparison comparison;
+    comparison.float32Ms = timeBestOf(numRuns, [&] { float32Backend.run(mag); });
+    comparison.reducedMs = timeBestOf(numRuns, [&] { reducedBackend.run(mag); });
+
+    DBG(getStemName(stem) << " float32: " << comparison.float32Ms << " ms, " << getPrecisionName(reduced) << ": "
+        << comparison.reducedMs << " ms, speedup " << comparison.getSpeedup() << "x");
+
+    return comparison;
+}
+
+bool ModelSession::isInt8Available() const
+{
+    for (int i = 0; i < numStems; ++i)
+        if (!pack->contains(getStemName(static_cast<Stem>(i)) + "_int8"))
+            return false;
+
+    return true;
+}
+
+bool ModelSession::isBFloat16Available()
+{
+    return CpuFeatures::supportsBFloat16Inference();
+}
+
+ModelSession::Precision ModelSession::getPrecisionFromEnvironment()
+{
+    const juce::String name = juce::SystemStats::getEnvironmentVariable("LARS_PRECISION", "float32").trim();
+
+    if (name.equalsIgnoreCase("int8"))
+        return Precision::int8;
+
+    if (name.equalsIgnoreCase("bf16") || name.equalsIgnoreCase("bfloat16"))
+        return Precision::bfloat16;
+
+    return Precision::float32;
+}
+
+juce::String ModelSession::getPrecisionName(Precision p)
+{
+    switch (p)
+    {
+    case Precision::int8:     return "int8";
+    case Precision::bfloat16: return "bfloat16";
+    default:                  break;
+    }
+
+    return "float32";
+}
+
+ModelSession::Precision ModelSession::getActivePrecision() const
+{
+    const Precision requested = precision.load();
+
+    if (requested == Precision::int8 && int8Loaded.load())
+        return Precision::int8;
+
+    if (requested == Precision::bfloat16 && bf16Loaded.load())
+        return Precision::bfloat16;
+
+    return Precision::float32;
+}
+
+std::unique_ptr<InferenceBackend> ModelSession::createStemBackend(Stem stem, const BackendConfig::Entry& entry) const
+{
+    if (entry.type == BackendConfig::Type::onnxRuntime)
+    {
+       #if LARS_WITH_ONNXRUNTIME
+        try {
+            // the exported graph is the LarsNet core, the adapter does the folding around it
+            return std::make_unique<LarsNetSegmentAdapter>(std::make_unique<OnnxRuntimeBackend>(entry.modelFile, entry.intraOpThreads));
+        }
+        catch (const std::exception& e) {
+            DBG("error loading " << entry.modelFile.getFullPathName() << " with ONNX Runtime, using the libtorch JIT: " << e.what());
+        }
+       #else
+        DBG(getStemName(stem) << " is configured for ONNX Runtime but this build doesn't have it, using the libtorch JIT");
+       #endif
+    }
+
+    if (entry.type == BackendConfig::Type::aotInductor)
+    {
+       #if LARS_HAS_AOTI
+        try {
+            // compiled for the fixed segment shape, the adapter does the folding around it
+            return std::make_unique<LarsNetSegmentAdapter>(std::make_unique<AotInductorBackend>(entry.modelFile));
+        }
+        catch (const std::exception& e) {
+            DBG("error loading " << entry.modelFile.getFullPathName() << " with AOTInductor, using the libtorch JIT: " << e.what());
+        }
+       #else
+        DBG(getStemName(stem) << " is configured for AOTInductor but this libtorch is older than 2.2, using the libtorch JIT");
+       #endif
+    }
+
+    if (entry.channelsLast)
+    {
+        // runs the submodules one by one, so the module can't be frozen
+        return std::make_unique<LarsNetSegmentAdapter>(
+            std::make_unique<LarsNetLayerBackend>(loadStemModule(stem), LarsNetLayerBackend::Layout::channelsLast));
+    }
+
+    return std::make_unique<TorchJitBackend>(prepareModule(loadStemModule(stem)));
+}
+
+std::unique_ptr<InferenceBackend> ModelSession::createDemucsBackend(const BackendConfig::Entry& entry) const
+{
+    if (entry.type == BackendConfig::Type::onnxRuntime)
+    {
+       #if LARS_WITH_ONNXRUNTIME
+        try {
+            return std::make_unique<OnnxRuntimeBackend>(entry.modelFile, entry.intraOpThreads);
+        }
+        catch (const std::exception& e) {
+            DBG("error loading " << entry.modelFile.getFullPathName() << " with ONNX Runtime, using the libtorch JIT: " << e.what());
+        }
+       #else
+        DBG("HTDemucs is configured for ONNX Runtime but this build doesn't have it, using the libtorch JIT");
+       #endif
+    }
+
+    if (entry.type == BackendConfig::Type::aotInductor)
+        DBG("AOTInductor is only supported for the LarsNet stems, running HTDemucs with the libtorch JIT");
+
+    return std::make_unique<TorchJitBackend>(prepareModule(pack->loadModule("htdemucs")));
+}
+
+bool ModelSession::loadStemTier(Precision p, std::array<std::unique_ptr<InferenceBackend>, numStems>& backends) const
+{
+    try {
+        // reduced tiers only exist for the libtorch modules, stems moved to
+        // another runtime keep using their float32 backend
+        for (int i = 0; i < numStems; ++i)
+        {
+            const auto stem = static_cast<Stem>(i);
+
+            if (backendConfig.getEntry(getStemName(stem)).type == BackendConfig::Type::torchJit)
+                backends[i] = std::make_unique<TorchJitBackend>(prepareModule(loadStemModule(stem, p)), getComputeType(p));
+        }
+
+        return true;
+    }
+    catch (const std::exception& e) {
+        DBG("error loading the " << getPrecisionName(p) << " LarsNet modules, using float32: " << e.what());
+    }
+
+    return false;
+}
+
+bool ModelSession::loadStem(Stem stem) const
+{
+    if (stemLoaded[stem].load())
+        return true;
+
+    std::lock_guard<std::mutex> lock(stemMutex);
+
+    if (stemLoaded[stem].load())
+        return true;
+
+    try {
+        stemBackends[stem] = createStemBackend(stem, backendConfig.getEntry(getStemName(stem)));
+        stemLoaded[stem] = true;
+    }
+    catch (const std::exception& e) {
+        DBG("error loading the " << getStemName(stem) << " LarsNet module: " << e.what());
+    }
+
+    return stemLoaded[stem].load();
+}
+
+void ModelSession::loadModels()
+{
+    std::lock_guard<std::mutex> lock(loadMutex);
+
+    if (!pack->isValid())
+        DBG("no model pack at " << pack->getFile().getFullPathName() << ", set LARS_MODEL_PACK or run net/make_model_pack.py");
+
+    for (int i = 0; i < numStems; ++i)
+        loadStem(static_cast<Stem>(i));
+
+    if (precision.load() == Precision::int8 && !int8Loaded)
+    {
+        if (isInt8Available())
+            int8Loaded = loadStemTier(Precision::int8, int8StemBackends);
+        else
+            DBG("INT8 requested but the model pack has no INT8 modules, using float32");
+    }
+
+    if (precision.load() == Precision::bfloat16 && !bf16Loaded)
+    {
+        if (isBFloat16Available())
+            bf16Loaded = loadStemTier(Precision::bfloat16, bf16StemBackends);
+        else
+            DBG("bfloat16 requested but this CPU has neither AVX512-BF16 nor AMX, using float32");
+    }
+
+    if (!ensembleLoaded && pack->contains("ensemble"))
+    {
+        try {
+            ensembleModule = prepareModule(pack->loadModule("ensemble"));
+            ensembleLoaded = true;
+        }
+        catch (const std::exception& e) {
+            DBG("error loading the LarsNet ensemble, using the separate stem modules: " << e.what());
+        }
+    }
+
+    if (!demucsLoaded)
+    {
+        try {
+            demucsBackend = createDemucsBackend(backendConfig.getEntry("htdemucs"));
+            demucsLoaded = true;
+        }
+        catch (const std::exception& e) {
+            DBG("error loading HTDemucs: " << e.what());
+        }
+    }
+}
+
+void ModelSession::warmUp()
+{
+    // the profiling executor records shapes on the first runs and only then
+    // emits the optimized graph, so run once more than the profiled count
+    const int numWarmUpRuns = static_cast<int>(torch::jit::getNumProfiledRuns().load()) + 1;
+    const torch::Tensor dummy = torch::zeros({ 1, 2, 2049, 512 });
+
+    for (int run = 0; run < numWarmUpRuns; ++run)
+        inferStems(dummy);
+}
+
+bool ModelSession::areStemModelsLoaded() const
+{
+    for (const auto& loaded : stemLoaded)
+        if (!loaded.load())
+            return false;
+
+    return true;
+}
+
+bool ModelSession::isDemucsLoaded() const
+{
+    return demucsLoaded.load();
+}
+
+bool ModelSession::isEnsembleLoaded() const
+{
+    return ensembleLoaded.load();
+}
+
+torch::Tensor ModelSession::inferStem(Stem stem, const torch::Tensor& mag) const
+{
+    const Precision active = getActivePrecision();
+    const InferenceBackend* backend = active == Precision::int8     ? int8StemBackends[stem].get()
+                                    : active == Precision::bfloat16 ? bf16StemBackends[stem].get()
+                                                                    : nullptr;
+
+    if (backend == nullptr)
+    {
+        // stems are loaded on first use when nobody called loadModels()
+        if (!loadStem(stem))
+            throw std::runtime_error(("the " + getStemName(stem) + " LarsNet model couldn't be loaded").toStdString());
+
+        backend = stemBackends[stem].get();
+    }
+
+    return backend->run(mag);
+}
+
+std::vector<torch::Tensor> ModelSession::inferStems(const torch::Tensor& mag) const
+{
+    // the ensemble is a float32 graph, the INT8 tier runs the quantized stems one by one
+    if (isEnsembleLoaded() && getActivePrecision() == Precision::float32)
+        return inferEnsemble(mag);
+
+    std::vector<torch::Tensor> outputs;
+    outputs.reserve(numStems);
+
+    for (int i = 0; i < numStems; ++i)
+        outputs.push_back(inferStem(static_cast<Stem>(i), mag));
+
+    return outputs;
+}
+
+std::vector<torch::Tensor> ModelSession::inferEnsemble(const torch::Tensor& mag) const
+{
+    torch::jit::script::Module module = ensembleModule;
+
+    c10::InferenceMode guard;
+    std::vector<torch::jit::IValue> inputs{ mag };
+
+    // [N, numStems, 2, F, T] -> one [N, 2, F, T] tensor per stem
+    torch::Tensor output = module.forward(inputs).toTensor();
+    return output.unbind(1);
+}
+
+torch::Tensor ModelSession::inferDemucs(const torch::Tensor& audio) const
+{
+    // HTDemucs computes its own spectrogram inside the graph, so it isn't cast
+    // to bfloat16 as a whole: autocast runs the convolutions, linears and
+    // attention in bfloat16 and leaves stft/istft in float32
+    if (precision.load() == Precision::bfloat16 && isBFloat16Available())
+    {
+        try {
+            CpuAutocastGuard autocast;
+            return demucsBackend->run(audio).to(at::kFloat);
+        }
+        catch (const c10::Error& e) {
+            DBG("HTDemucs failed under bfloat16 autocast, running it in float32: " << e.what());
+        }
+    }
+
+    return demucsBackend->run(audio);
+}
+
+juce::String ModelSession::getStemName(Stem stem)
+{
+    switch (stem)
+    {
+    case kick:    return "kick";
+    case snare:   return "snare";
+    case toms:    return "toms";
+    case hihat:   return "hihat";
+    case cymbals: return "cymbals";
+    default:      break;
+    }
+
+    return {};
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+#include <torch/torch.h>
+#include <torch/script.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "BackendConfig.h"
+#include "InferenceBackend.h"
+#include "ModelPack.h"
+
+
+//==============================================================================
+/**
+    Owns every model used by the plugin (the five LarsNet stem UNets and
+    HTDemucs). The models are loaded once and reused by every separation;
+    inference calls don't touch any shared state, so they can be issued again
+    (or from several threads) without reloading anything.
+
+    Each model runs behind an InferenceBackend, the libtorch JIT unless the
+    BackendConfig (LARS_BACKEND_CONFIG) moves it to another runtime.
+
+    The models come from a memory-mapped ModelPack and nothing is read from it
+    until a model is needed: stems are loaded one by one, on first use or on a
+    background thread started with startLoading(); listeners get a change
+    message whenever getState() moves.
+*/
+class ModelSession : public juce::ChangeBroadcaster
+{
+public:
+    enum Stem
+    {
+        kick = 0,
+        snare,
+        toms,
+        hihat,
+        cymbals,
+        numStems
+    };
+
+    /** The rate HTDemucs and LarsNet were trained at, other input is resampled to it. */
+    static constexpr double sampleRate = 44100.0;
+
+    enum class State
+    {
+        idle,
+        loading,
+        ready,
+        failed
+    };
+
+    /** Numeric tier used for the LarsNet stem models. HTDemucs runs in float32,
+        or under bfloat16 autocast in the bfloat16 tier. */
+    enum class Precision
+    {
+        float32,
+        int8,
+        bfloat16
+    };
+
+    ModelSession();
+    ~ModelSession() override;
+
+    /** Load and warm up all modules on a background thread. */
+    void startLoading();
+
+    /** Load all modules. Calling it again once everything is loaded is a no-op. */
+    void loadModels();
+
+    /** Load one stem model if it isn't loaded yet. Returns false if it can't be loaded. */
+    bool loadStem(Stem stem) const;
+
+    /** Run every stem model on a dummy [1, 2, 2049, 512] input so the JIT has
+        already profiled and specialized its graphs before the first real job. */
+    void warmUp();
+
+    State getState() const { return state.load(); }
+    bool isReady() const { return state.load() == State::ready; }
+
+    /** Why loading failed, once getState() is State::failed. */
+    juce::String getLoadError() const;
+
+    bool areStemModelsLoaded() const;
+    bool isDemucsLoaded() const;
+
+    /** True when the fused LarsNet ensemble (all five stems as one grouped-conv graph) is available. */
+    bool isEnsembleLoaded() const;
+
+    /** Run one LarsNet model on a [1, 2, F, T] magnitude spectrogram. Inference
+        runs under c10::InferenceMode, the outputs are inference tensors. */
+    torch::Tensor inferStem(Stem stem, const torch::Tensor& mag) const;
+
+    /** Run all five LarsNet models on the same magnitude spectrogram, in Stem order.
+        Uses the fused ensemble when it is loaded. */
+    std::vector<torch::Tensor> inferStems(const torch::Tensor& mag) const;
+
+    /** One forward of the fused ensemble, returns the five [1, 2, F, T] stems in Stem order. */
+    std::vector<torch::Tensor> inferEnsemble(const torch::Tensor& mag) const;
+
+    /** Run HTDemucs on a [B, 2, N] waveform batch. */
+    torch::Tensor inferDemucs(const torch::Tensor& audio) const;
+
+    static juce::String getStemName(Stem stem);
+
+    //==============================================================================
+    /** Pick the tier used for the stem models. The INT8 / bfloat16 modules are
+        loaded by the next loadModels() call; until they are in, in builds without
+        INT8 modules and on CPUs without native bfloat16, the float32 modules keep
+        being used. The initial tier comes from the LARS_PRECISION environment
+        variable ("float32", "int8" or "bf16"). */
+    void setPrecision(Precision newPrecision) { precision = newPrecision; }
+    Precision getPrecision() const { return precision.load(); }
+
+    /** The tier inference actually runs with right now. */
+    Precision getActivePrecision() const;
+
+    /** True when the model pack has INT8 stem modules, which it only gets when they passed the SDR gate. */
+    bool isInt8Available() const;
+
+    /** True when this CPU has AVX512-BF16 or AMX, see CpuFeatures. */
+    static bool isBFloat16Available();
+
+    static Precision getPrecisionFromEnvironment();
+    static juce::String getPrecisionName(Precision p);
+
+    //==============================================================================
+    /** Replace the backend config read from LARS_BACKEND_CONFIG. Only models
+        loaded after the call are affected. */
+    void setBackendConfig(const BackendConfig& config) { backendConfig = config; }
+    const BackendConfig& getBackendConfig() const { return backendConfig; }
+
+    /** A float32 backend for one stem as described by entry (falls back to the
+        libtorch JIT when the entry's runtime isn't available). */
+    std::unique_ptr<InferenceBackend> createStemBackend(Stem stem, const BackendConfig::Entry& entry) const;
+
+    //==============================================================================
+    /** Freeze and optimize the modules as they are loaded (on by default). */
+    void setOptimizeOnLoad(bool shouldOptimize) { optimizeOnLoad = shouldOptimize; }
+
+    /** A frozen, inference-only copy of a scripted module: weights become
+        constants, BatchNorms are folded where the graph allows it and the
+        frozen-graph passes of optimize_for_inference are applied. */
+    static torch::jit::script::Module optimizeForInference(const torch::jit::script::Module& module);
+
+    /** Deserialize a stem from the model pack, as scripted. The float32 module
+        is cast to bfloat16 for Precision::bfloat16. */
+    torch::jit::script::Module loadStemModule(Stem stem, Precision p = Precision::float32) const;
+
+    const ModelPack& getModelPack() const { return *pack; }
+
+    struct LatencyComparison
+    {
+        double scriptedMs{ 0.0 };
+        double optimizedMs{ 0.0 };
+
+        double getSpeedup() const { return optimizedMs > 0.0 ? scriptedMs / optimizedMs : 0.0; }
+    };
+
+    /** Time one stem model as scripted against its optimized copy on the same input (best of numRuns). */
+    LatencyComparison compareOptimizedLatency(Stem stem, const torch::Tensor& mag, int numRuns = 3) const;
+
+    struct PrecisionComparison
+    {
+        double float32Ms{ 0.0 };
+        double reducedMs{ 0.0 };
+
+        double getSpeedup() const { return reducedMs > 0.0 ? float32Ms / reducedMs : 0.0; }
+    };
+
+    /** Time the float32 module of one stem against its INT8 or bfloat16 version on the same input (best of numRuns). */
+    PrecisionComparison comparePrecisionLatency(Stem stem, Precision reduced, const torch::Tensor& mag, int numRuns = 3) const;
+
+private:
+    class LoaderThread : public juce::Thread
+    {
+    public:
+        LoaderThread(ModelSession& s) : juce::Thread("Model Loader Thread"), session(s)
+        {
+        }
+
+        void run() override;
+
+    private:
+        ModelSession& session;
+    };
+
+    void setState(State newState);
+    bool loadStemTier(Precision p, std::array<std::unique_ptr<InferenceBackend>, numStems>& backends) const;
+    std::unique_ptr<InferenceBackend> createDemucsBackend(const BackendConfig::Entry& entry) const;
+    torch::jit::script::Module prepareModule(torch::jit::script::Module module) const;
+
+    // loaded lazily from const inference calls, guarded by stemMutex
+    mutable std::array<std::unique_ptr<InferenceBackend>, numStems> stemBackends;
+    mutable std::array<std::atomic<bool>, numStems> stemLoaded{};
+    mutable std::mutex stemMutex;
+
+    std::array<std::unique_ptr<InferenceBackend>, numStems> int8StemBackends;
+    std::array<std::unique_ptr<InferenceBackend>, numStems> bf16StemBackends;
+    std::unique_ptr<InferenceBackend> demucsBackend;
+    torch::jit::script::Module ensembleModule;
+
+    std::atomic<bool> demucsLoaded{ false };
+    std::atomic<bool> ensembleLoaded{ false };
+    std::atomic<bool> int8Loaded{ false };
+    std::atomic<bool> bf16Loaded{ false };
+    std::atomic<Precision> precision;
+    std::atomic<State> state{ State::idle };
+    juce::String loadError; // written by the loader before it sets State::failed
+    bool optimizeOnLoad{ true };
+    BackendConfig backendConfig;
+    std::unique_ptr<ModelPack> pack;
+
+    std::mutex loadMutex;
+
+    LoaderThread loaderThread{ *this };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ModelSession)
+};
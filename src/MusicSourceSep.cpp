@@ -8,6 +8,8 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <cmath>
+#include <limits>
 
 // Function to get an audio buffer from a file
 juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file, juce::AudioFormatManager &formatManager, double &sampleRate)
@@ -18,6 +20,11 @@ juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file, juce::AudioForm
         throw std::runtime_error("Failed to create reader for audio file.");
     }
     sampleRate = reader->sampleRate;
+    if (reader->lengthInSamples > std::numeric_limits<int>::max())
+    {
+        delete reader;
+        throw std::runtime_error("Audio file too long for an AudioBuffer.");
+    }
     juce::AudioBuffer<float> audioBuffer;
     audioBuffer.setSize(reader->numChannels, static_cast<int>(reader->lengthInSamples));
     reader->read(&audioBuffer, 0, static_cast<int>(reader->lengthInSamples), 0, true, true);
@@ -25,41 +32,148 @@ juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file, juce::AudioForm
     return audioBuffer;
 }
 
-std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, int window_size, int stride)
+int OverlapAddSettings::getFadeLength() const
 {
-    int numSamples = audioBuffer.getNumSamples();
-    int numChannels = audioBuffer.getNumChannels();
-    int num_windows = (numSamples + stride - 1) / stride; 
+    return juce::jlimit(0, windowLength / 2, static_cast<int>(std::lround(windowLength * overlap)));
+}
 
-    std::vector<torch::Tensor> windows;
-    for (int i = 0; i < num_windows; ++i)
+int OverlapAddSettings::getHop() const
+{
+    return windowLength - getFadeLength();
+}
+
+// rough peak activation memory of an HTDemucs forward, about 300 MB per
+// batch item for a 485100-sample window
+static constexpr int64_t demucsBytesPerSample = 640;
+
+int OverlapAddSettings::getBatchSize(int numWindows) const
+{
+    int windowsPerBatch = batchSize;
+
+    if (windowsPerBatch <= 0)
     {
-        int start = i * stride;
-        int end = std::min(start + window_size, numSamples);
+        const int64_t bytesPerWindow = static_cast<int64_t>(windowLength) * demucsBytesPerSample;
+        windowsPerBatch = static_cast<int>(static_cast<int64_t>(memoryBudgetMB) * 1024 * 1024 / bytesPerWindow);
+    }
 
-        std::vector<float> windowData;
-        for (int ch = 0; ch < numChannels; ++ch) {
-            const float* channelData = audioBuffer.getReadPointer(ch) + start;
-            windowData.insert(windowData.end(), channelData, channelData + (end - start));
+    return juce::jlimit(1, juce::jmax(1, numWindows), windowsPerBatch);
+}
 
-            // Check if this is the last window and needs padding for the current channel
-            if ((end - start) < window_size) {
-                int paddingSize = window_size - (end - start);
-                windowData.insert(windowData.end(), paddingSize, 0.0f); // Zero padding for the current channel
-            }
-        }
+int getNumWindows(juce::int64 numSamples, int window_size, int stride)
+{
+    if (numSamples <= window_size)
+        return 1;
 
+    return static_cast<int>(1 + (numSamples - window_size + stride - 1) / stride);
+}
 
-        torch::Tensor tensor = torch::from_blob(windowData.data(), {numChannels, window_size}, torch::kFloat32).clone();
-        std::cout << " shape tensor in adjustAudioBufferToExpectedLength: " << tensor.sizes() << std::endl;
+std::vector<AudioWindow> getWindowLayout(juce::int64 numSamples, const OverlapAddSettings &settings)
+{
+    const int windowLength = settings.windowLength;
+    const int hop = settings.getHop();
+    const int numWindows = getNumWindows(numSamples, windowLength, hop);
+
+    std::vector<AudioWindow> layout;
+    for (int i = 0; i < numWindows; ++i)
+        layout.push_back({ static_cast<juce::int64>(i) * hop, windowLength });
+
+    AudioWindow &last = layout.back();
+
+    if (numWindows > 1 && settings.tail == OverlapAddSettings::Tail::shiftBack)
+        last.start = numSamples - windowLength;
+
+    return layout;
+}
+
+std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, int window_size, int stride)
+{
+    std::vector<AudioWindow> layout;
+    for (int i = 0; i < getNumWindows(audioBuffer.getNumSamples(), window_size, stride); ++i)
+        layout.push_back({ static_cast<juce::int64>(i) * stride, window_size });
+
+    return adjustAudioBufferToExpectedLength(audioBuffer, layout);
+}
+
+std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, const std::vector<AudioWindow> &layout)
+{
+    BufferSampleSource source(audioBuffer);
+
+    std::vector<torch::Tensor> windows;
+    for (const AudioWindow &window : layout)
+        windows.push_back(readWindow(source, window));
 
-        windows.push_back(tensor);
-    }
     std::cout << " result of adjustAudioBufferToExpectedLength: " << windows.size() << std::endl;
 
     return windows;
 }
 
+torch::Tensor readWindow(SampleSource &source, const AudioWindow &window)
+{
+    return source.readTensor(window.start, window.length);
+}
+
+torch::Tensor makeWindowWeights(int windowLength, int fadeLength, bool fadeIn, bool fadeOut, OverlapAddSettings::Fade fade,
+                                int fadeInOffset)
+{
+    torch::Tensor weights = torch::ones({ windowLength });
+
+    // a window shifted back over the previous one leaves that stretch to it
+    if (fadeIn && fadeInOffset > 0)
+        weights.narrow(0, 0, fadeInOffset).zero_();
+
+    if (fadeLength <= 0)
+        return weights;
+
+    // sampled at half-sample offsets so both ends stay above zero and a
+    // fade-out plus the next window's fade-in add up to exactly one
+    torch::Tensor ramp = (torch::arange(fadeLength, torch::kFloat32) + 0.5f) / static_cast<float>(fadeLength);
+
+    if (fade == OverlapAddSettings::Fade::raisedCosine)
+        ramp = torch::sin(ramp * juce::MathConstants<float>::halfPi).pow(2);
+
+    if (fadeIn)
+        weights.narrow(0, fadeInOffset, fadeLength).copy_(ramp);
+
+    if (fadeOut)
+        weights.narrow(0, windowLength - fadeLength, fadeLength).copy_(ramp.flip(0));
+
+    return weights;
+}
+
+torch::Tensor overlapAdd(const std::vector<torch::Tensor> &windows, const std::vector<AudioWindow> &layout, juce::int64 numSamples,
+                         const OverlapAddSettings &settings)
+{
+    const int numWindows = static_cast<int>(windows.size());
+    const int fadeLength = settings.getFadeLength();
+
+    juce::int64 paddedLength = numSamples;
+    for (const AudioWindow &window : layout)
+        paddedLength = std::max(paddedLength, window.getEnd());
+
+    torch::Tensor output = torch::zeros({ windows[0].size(0), paddedLength });
+    torch::Tensor weightSum = torch::zeros({ paddedLength });
+
+    for (int i = 0; i < numWindows; ++i)
+    {
+        const AudioWindow &window = layout[i];
+        const int fadeInOffset = (i > 0) ? static_cast<int>(layout[i - 1].getEnd() - fadeLength - window.start) : 0;
+        const torch::Tensor weights = makeWindowWeights(window.length, fadeLength, i > 0, i < numWindows - 1, settings.fade, fadeInOffset);
+
+        output.narrow(1, window.start, window.length).add_(windows[i] * weights);
+        weightSum.narrow(0, window.start, window.length).add_(weights);
+    }
+
+    // the fades are complementary, dividing only corrects rounding
+    output = output / weightSum.clamp_min(1e-8f);
+    return output.narrow(1, 0, numSamples);
+}
+
+void SeparationReport::print(std::ostream &out) const
+{
+    out << "HTDemucs: " << numWindows << " windows, " << paddedSamples << " padded samples (zero-padded tail: "
+        << zeroPadPaddedSamples << "), " << windowMs << " ms per window" << std::endl;
+}
+
 void printTensorShape(const torch::Tensor &tensor, const std::string &name)
 {
     std::cout << name << " shape: " << tensor.sizes() << std::endl;
@@ -70,89 +184,83 @@ void printBufferShape(const juce::AudioBuffer<float> &buffer, const std::string
     std::cout << name << " shape: [" << buffer.getNumChannels() << ", " << buffer.getNumSamples() << "]" << std::endl;
 }
 
-std::vector<torch::Tensor> musicSourceSeparation(const juce::AudioBuffer<float> buffer)
+AudioTensor musicSourceSeparation(const juce::AudioBuffer<float> &buffer, const ModelSession &session, InferenceScheduler &scheduler,
+                                  const OverlapAddSettings &settings, SeparationReport *report)
 {
-    std::vector<torch::Tensor> musicSourceSepRes;
-    juce::AudioBuffer<float> audioBuffer = buffer;
-
-    std::string modelFilePath = "../../../../../../../Resources/model_jit.pth";
-    torch::jit::script::Module module;
-    try
-    {
-        module = torch::jit::load(modelFilePath);
-        std::cout << "Model loaded successfully." << std::endl;
-    }
-    catch (const c10::Error &e)
-    {
-        std::cerr << "Error loading the model: " << e.what() << std::endl;
-    }
+    // mono buffers are read on both channels
+    printBufferShape(buffer, "audioBuffer");
+    BufferSampleSource source(buffer);
+    return musicSourceSeparation(source, session, scheduler, settings, report);
+}
 
-    if (audioBuffer.getNumChannels() != 2)
+AudioTensor musicSourceSeparation(SampleSource &source, const ModelSession &session, InferenceScheduler &scheduler,
+                                  const OverlapAddSettings &settings, SeparationReport *report)
+{
+    if (!session.isDemucsLoaded())
     {
-        juce::AudioBuffer<float> stereoBuffer(2, audioBuffer.getNumSamples());
-        stereoBuffer.copyFrom(0, 0, audioBuffer, 0, 0, audioBuffer.getNumSamples());
-        if (audioBuffer.getNumChannels() == 1)
-        {
-            stereoBuffer.copyFrom(1, 0, audioBuffer, 0, 0, audioBuffer.getNumSamples());
-        }
-        audioBuffer = std::move(stereoBuffer);
-        printBufferShape(audioBuffer, "Stereo audioBuffer");
+        throw std::runtime_error("HTDemucs model is not loaded.");
     }
 
-    int numSamples = audioBuffer.getNumSamples();
-    const int window_size = 485100;
-    const int stride = 485100;
+    const juce::int64 numSamples = source.getNumSamples();
 
-    std::vector<torch::Tensor> audioWindows = adjustAudioBufferToExpectedLength(audioBuffer, window_size, stride);
-    printTensorShape(audioWindows[0], "audioWindows[0]");
-    printTensorShape(audioWindows[1], "audioWindows[1]");
+    const std::vector<AudioWindow> layout = getWindowLayout(numSamples, settings);
 
-    int numTensors = audioWindows.size();
-    std::vector<torch::Tensor> selectedParts;
+    // every window is independent, overlapAdd() stitches them in index order
+    // whatever order they are computed in
+    int numTensors = static_cast<int>(layout.size());
+    std::vector<torch::Tensor> selectedParts(numTensors);
 
-    for (int i = 0; i < numTensors; ++i)
+    // Runs windows [first, first + count) as one batch, returns its HTDemucs time in ms.
+    // The windows are only read from the source here, a batch at a time; a failed forward throws.
+    auto runBatch = [&](int first, int count) -> double
     {
-        torch::Tensor audioTensor = audioWindows[i].unsqueeze(0); // Add batch dimension
+        const int window_size = layout[first].length;
+        std::vector<torch::Tensor> batchWindows;
+        for (int i = 0; i < count; ++i)
+            batchWindows.push_back(readWindow(source, layout[first + i]));
+
+        torch::Tensor audioTensor = torch::stack(batchWindows); // (count, 2, window_size)
         printTensorShape(audioTensor, "audioTensor");
 
-        std::vector<torch::jit::IValue> inputs;
-        inputs.push_back(audioTensor);
-        torch::Tensor output;
-        try
-        {
-            output = module.forward(inputs).toTensor(); // Model output
-            std::cout << "Model inference completed successfully." << std::endl;
-            printTensorShape(output, "Model output");
-
-            selectedParts.push_back(output.select(1, 0).view({1, 2, 485100}));
-        }
-        catch (const c10::Error &e)
-        {
-            std::cerr << "Error during model inference: " << e.what() << std::endl;
-        }
-    }
+        const double begin = juce::Time::getMillisecondCounterHiRes();
+        torch::Tensor output = scheduler.runDemucs(session, audioTensor); // Model output, queued on the shared scheduler
+        const double elapsedMs = juce::Time::getMillisecondCounterHiRes() - begin;
+        std::cout << "Model inference completed successfully." << std::endl;
+        printTensorShape(output, "Model output");
 
-    torch::Tensor output = torch::cat(selectedParts, 2); // (1, 2, numTensors * 485100)
-    std::cout << "Resulting tensor shape: " << output.sizes() << std::endl;
+        for (int i = 0; i < count; ++i)
+            selectedParts[first + i] = output[i].select(0, 0).view({2, window_size}); // drums source
 
-    output = output.index({"...", torch::indexing::Slice(0, numSamples)});
-    printTensorShape(output, "Trimmed output");
+        return elapsedMs;
+    };
 
-    torch::Tensor drums = output[0];
-    printTensorShape(drums, "drums tensor");
+    // windows are stacked along the batch dimension, fewer and bigger forwards
+    const int batchSize = settings.getBatchSize(numTensors);
+    double windowsMs = 0.0;
 
-    if (drums.size(0) != 2) {
-        std::cerr << "Error: The tensor does not have 2 channels." << std::endl;
+    for (int first = 0; first < numTensors;)
+    {
+        const int count = juce::jmin(batchSize, numTensors - first);
+        windowsMs += runBatch(first, count);
+        first += count;
     }
 
-    for (int ch = 0; ch < drums.size(0); ++ch) {
-        torch::Tensor channelTensor = drums.select(0, ch).unsqueeze(0);
-        musicSourceSepRes.push_back(channelTensor);
+    if (report != nullptr)
+    {
+        report->numWindows = numTensors;
+        report->paddedSamples = juce::jmax<juce::int64>(0, layout.back().getEnd() - numSamples);
+        report->zeroPadPaddedSamples = static_cast<int64_t>(getNumWindows(numSamples, settings.windowLength, settings.getHop()) - 1)
+                                           * settings.getHop() + settings.windowLength - numSamples;
+        report->windowMs = windowsMs / numTensors;
     }
-    printTensorShape(musicSourceSepRes[0], "musicSourceSepRes 0 tensor");
-    printTensorShape(musicSourceSepRes[1], "musicSourceSepRes 1 tensor");
 
+    torch::Tensor drums = overlapAdd(selectedParts, layout, numSamples, settings); // (2, numSamples)
+    printTensorShape(drums, "drums tensor");
 
+    if (drums.size(0) != 2) {
+        std::cerr << "Error: The tensor does not have 2 channels." << std::endl;
+    }
 
-    return musicSourceSepRes;
+    // overlapAdd() only narrows its result, the channels are handed over where they are
+    return AudioTensor(drums);
 }
@@ -1,3 +1,4 @@
+#pragma once
 
 #include <torch/torch.h>
 #include <torch/script.h>
@@ -8,13 +9,116 @@
 #include <vector>
 #include <string>
 
-// Function to get an audio buffer from a file
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+#include "SampleSource.h"
+#include "AudioTensor.h"
+
+/** How musicSourceSeparation() cuts the track into HTDemucs windows and stitches them back. */
+struct OverlapAddSettings
+{
+    enum class Fade
+    {
+        linear,
+        raisedCosine
+    };
+
+    /** What to do with the part of the track past the last full window. Both cost a full
+        HTDemucs window, it pads anything shorter back up to its training segment. */
+    enum class Tail
+    {
+        zeroPad,  // a full window, zero-padded past the end of the track
+        shiftBack // a full window ending at the end of the track, overlapping the previous one more
+    };
+
+    /** Samples per HTDemucs call. Shorter windows use less memory per call; HTDemucs
+        pads anything shorter than its training segment (485100) internally. */
+    int windowLength = 485100;
+
+    /** Fraction of windowLength shared by neighbouring windows, 0 gives hard-edged windows. */
+    double overlap = 0.25;
+
+    Fade fade = Fade::raisedCosine;
+
+    /** Windows stacked into one [B, 2, windowLength] HTDemucs forward. 0 picks as
+        many as fit in memoryBudgetMB. Off by default: the kernels picked for a
+        bigger batch can round differently, so batched drums are only bit-identical
+        to one window at a time where LARSBenchmark's batching check passes. */
+    int batchSize = 1;
+
+    /** Peak memory one batched forward may use when batchSize is 0. */
+    int memoryBudgetMB = 2048;
+
+    /** shiftBack fills the last window with audio instead of silence. */
+    Tail tail = Tail::shiftBack;
+
+    int getFadeLength() const;
+    int getHop() const;
+
+    /** Windows per forward for a track of numWindows windows, at least 1. */
+    int getBatchSize(int numWindows) const;
+};
+
+/** One window of the track, [start, start + length); may run past the end of the track. */
+struct AudioWindow
+{
+    juce::int64 start = 0;
+    int length = 0;
+
+    juce::int64 getEnd() const { return start + length; }
+};
+
+/** Per-track summary of the HTDemucs pass, filled in by musicSourceSeparation() for the caller to print. */
+struct SeparationReport
+{
+    int numWindows = 0;
+    int64_t paddedSamples = 0;       // zeros fed to the model past the end of the track
+    int64_t zeroPadPaddedSamples = 0; // the same with Tail::zeroPad
+    double windowMs = 0.0;           // average HTDemucs time per window
+
+    void print(std::ostream &out) const;
+};
+
+// Function to get an audio buffer from a file. Throws for files longer than an AudioBuffer
+// can hold, read those through a ReaderSampleSource instead.
 juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file, juce::AudioFormatManager &formatManager, double &sampleRate);
 
 std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, int window_size, int stride);
 
+std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, const std::vector<AudioWindow> &layout);
+
+/** One [2, window.length] window read from source, zero-padded past its end. */
+torch::Tensor readWindow(SampleSource &source, const AudioWindow &window);
+
+/** Number of windows of window_size every stride samples needed to cover numSamples. */
+int getNumWindows(juce::int64 numSamples, int window_size, int stride);
+
+/** Where the windows go for a track of numSamples, following settings.tail. */
+std::vector<AudioWindow> getWindowLayout(juce::int64 numSamples, const OverlapAddSettings &settings);
+
+/** Crossfade weights for one window: fades in over fadeLength samples from fadeInOffset
+    (zero before it) unless it's the first window, fades out over its last fadeLength
+    samples unless it's the last one. Complementary fades sum to 1. */
+torch::Tensor makeWindowWeights(int windowLength, int fadeLength, bool fadeIn, bool fadeOut, OverlapAddSettings::Fade fade,
+                                int fadeInOffset = 0);
+
+/** Stitch the per-window outputs ([C, layout[i].length] each) into [C, numSamples].
+    Each window fades in where the previous one fades out. The windows are always
+    summed in index order, so the result doesn't depend on the order in which they
+    were computed. */
+torch::Tensor overlapAdd(const std::vector<torch::Tensor> &windows, const std::vector<AudioWindow> &layout, juce::int64 numSamples,
+                         const OverlapAddSettings &settings);
+
 void printTensorShape(const torch::Tensor &tensor, const std::string &name);
 
 void printBufferShape(const juce::AudioBuffer<float> &buffer, const std::string &name);
 
-std::vector<torch::Tensor> musicSourceSeparation(const juce::AudioBuffer<float> buffer);
+/** The HTDemucs drums of the track, [2, numSamples]. Throws if an HTDemucs forward fails.
+    report, if given, gets the summary of the pass. */
+AudioTensor musicSourceSeparation(const juce::AudioBuffer<float> &buffer, const ModelSession &session, InferenceScheduler &scheduler,
+                                  const OverlapAddSettings &settings = {}, SeparationReport *report = nullptr);
+
+/** Same, reading the windows from source as they are needed, so only the output
+    has to fit in memory. */
+AudioTensor musicSourceSeparation(SampleSource &source, const ModelSession &session, InferenceScheduler &scheduler,
+                                  const OverlapAddSettings &settings = {}, SeparationReport *report = nullptr);
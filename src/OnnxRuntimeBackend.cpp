@@ -0,0 +1,56 @@
+#include "OnnxRuntimeBackend.h"
+
+#if LARS_WITH_ONNXRUNTIME
+
+#include <vector>
+
+
+Ort::Env& OnnxRuntimeBackend::getEnvironment()
+{
+    // one environment per process, shared by every session
+    static Ort::Env environment(ORT_LOGGING_LEVEL_WARNING, "LARS");
+    return environment;
+}
+
+OnnxRuntimeBackend::OnnxRuntimeBackend(const juce::File& modelFile, int intraOpThreads)
+{
+    Ort::SessionOptions options;
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+
+    if (intraOpThreads > 0)
+        options.SetIntraOpNumThreads(intraOpThreads);
+
+   #if JUCE_WINDOWS
+    session = std::make_unique<Ort::Session>(getEnvironment(), modelFile.getFullPathName().toWideCharPointer(), options);
+   #else
+    session = std::make_unique<Ort::Session>(getEnvironment(), modelFile.getFullPathName().toRawUTF8(), options);
+   #endif
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    inputName = session->GetInputNameAllocated(0, allocator).get();
+    outputName = session->GetOutputNameAllocated(0, allocator).get();
+}
+
+torch::Tensor OnnxRuntimeBackend::run(const torch::Tensor& input) const
+{
+    const torch::Tensor contiguous = input.to(at::kFloat).contiguous();
+    std::vector<int64_t> shape(contiguous.sizes().begin(), contiguous.sizes().end());
+
+    const Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    Ort::Value inputValue = Ort::Value::CreateTensor<float>(memoryInfo, contiguous.data_ptr<float>(),
+                                                            static_cast<size_t>(contiguous.numel()),
+                                                            shape.data(), shape.size());
+
+    const char* inputNames[] = { inputName.c_str() };
+    const char* outputNames[] = { outputName.c_str() };
+
+    std::vector<Ort::Value> outputs = session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputValue, 1, outputNames, 1);
+
+    const std::vector<int64_t> outputShape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+    float* outputData = outputs[0].GetTensorMutableData<float>();
+
+    return torch::from_blob(outputData, outputShape, at::kFloat).clone();
+}
+
+#endif
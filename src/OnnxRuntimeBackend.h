@@ -0,0 +1,38 @@
+#pragma once
+
+#include "InferenceBackend.h"
+
+#if LARS_WITH_ONNXRUNTIME
+
+#include <onnxruntime_cxx_api.h>
+#include <string>
+
+
+//==============================================================================
+/**
+    Runs an .onnx model with ONNX Runtime on the CPU execution provider, with
+    every graph optimization enabled. Single input, single output, float32.
+    Inputs are handed to ORT without a copy; the output is copied once into a
+    torch tensor. Ort::Session::Run is thread-safe, so one backend can serve
+    concurrent jobs.
+*/
+class OnnxRuntimeBackend : public InferenceBackend
+{
+public:
+    /** Throws Ort::Exception if the model can't be loaded. */
+    OnnxRuntimeBackend(const juce::File& modelFile, int intraOpThreads = 0);
+
+    juce::String getName() const override { return "onnxruntime"; }
+    torch::Tensor run(const torch::Tensor& input) const override;
+
+private:
+    static Ort::Env& getEnvironment();
+
+    std::unique_ptr<Ort::Session> session;
+    std::string inputName;
+    std::string outputName;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OnnxRuntimeBackend)
+};
+
+#endif
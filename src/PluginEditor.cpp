@@ -12,11 +12,14 @@
 #include "Utils.cpp"
 #include <JuceHeader.h>
 #include "MusicSourceSep.h"
+#include "SeparationEngine.h"
 
 
 #include <torch/torch.h>
 #include <torch/script.h>
 #include <cmath>
+#include <limits>
+#include <sstream>
 #include <chrono>
 #include <thread>
 #include <chrono>
@@ -341,67 +344,44 @@ DrumsDemixEditor::DrumsDemixEditor(DrumsDemixProcessor& p)
 
 
 
-    try {
-        //mymoduleKick=torch::jit::load("../src/scripted_modules/my_scripted_module_kick.pt");
-        //juce::String kickString = modelsDir.getFullPathName() + "/my_scripted_module_kick.pt";
-        //mymoduleKick = torch::jit::load(kickString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_kick_pt, BinaryData::my_scripted_module_kick_ptSize);
-        mymoduleKick = torch::jit::load(modelStream);
-        //MemoryInputStream* input = new MemoryInputStream(BinaryData::my_scripted_module_kick_pt, BinaryData::my_scripted_module_kick_ptSize, false);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
-
-
-    try {
-        //mymoduleSnare=torch::jit::load("../src/scripted_modules/my_scripted_module_snare.pt");
-        //juce::String snareString = modelsDir.getFullPathName() + "/my_scripted_module_snare.pt";
-        //mymoduleSnare = torch::jit::load(snareString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_snare_pt, BinaryData::my_scripted_module_snare_ptSize);
-        mymoduleSnare = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
+    //MODELS STATUS, the processor loads the TorchScript modules in the background
+    addAndMakeVisible(modelStatusLabel);
+    modelStatusLabel.setJustificationType(juce::Justification::centred);
+    modelStatusLabel.setFont(juce::Font(13.0f, juce::Font::bold));
+    audioProcessor.modelSession.addChangeListener(this);
+    updateModelStatus();
 
-    try {
-        //mymoduleToms=torch::jit::load("../src/scripted_modules/my_scripted_module_toms.pt");
-        //juce::String tomsString = modelsDir.getFullPathName() + "/my_scripted_module_toms.pt";
-        //mymoduleToms = torch::jit::load(tomsString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_toms_pt, BinaryData::my_scripted_module_toms_ptSize);
-        mymoduleToms = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
+    //LIVE MODE, separates the plugin input in real time
+    addAndMakeVisible(liveModeButton);
+    liveModeButton.setToggleState(audioProcessor.isLiveMode(), juce::dontSendNotification);
+    liveModeButton.addListener(this);
 
-    try {
-        //mymoduleHihat=torch::jit::load("../src/scripted_modules/my_scripted_module_hihat.pt");
-        //juce::String hihatString = modelsDir.getFullPathName() + "/my_scripted_module_hihat.pt";
-        //mymoduleHihat = torch::jit::load(hihatString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_hihat_pt, BinaryData::my_scripted_module_hihat_ptSize);
-        mymoduleHihat = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
-
-    try {
-        //mymoduleCymbals=torch::jit::load("../src/scripted_modules/my_scripted_module_cymbals.pt");
-        //juce::String cymbalsString = modelsDir.getFullPathName() + "/my_scripted_module_cymbals.pt";
-        //mymoduleCymbals = torch::jit::load(cymbalsString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_cymbals_pt, BinaryData::my_scripted_module_cymbals_ptSize);
-        mymoduleCymbals = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
+    addAndMakeVisible(liveStemBox);
+    liveStemBox.addItem("All stems", 1);
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        liveStemBox.addItem(ModelSession::getStemName(static_cast<ModelSession::Stem>(i)), i + 2);
+    liveStemBox.setSelectedId(1, juce::dontSendNotification);
+    liveStemBox.onChange = [this]
+    {
+        const int selected = liveStemBox.getSelectedId() - 2;
+        for (int i = 0; i < ModelSession::numStems; ++i)
+            audioProcessor.liveSeparator.setStemEnabled(static_cast<ModelSession::Stem>(i), selected < 0 || selected == i);
+    };
+
+    //WIENER FILTER, alpha only re-synthesizes the last separation, the models don't run again
+    addAndMakeVisible(wienerButton);
+    wienerButton.addListener(this);
+
+    addAndMakeVisible(wienerSlider);
+    wienerSlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    wienerSlider.setTextBoxStyle(juce::Slider::TextBoxRight, true, 36, 14);
+    wienerSlider.setRange(0.25, 4.0, 0.05);
+    wienerSlider.setValue(1.0, juce::dontSendNotification);
+    wienerSlider.onDragEnd = [this]
+    {
+        if (wienerButton.getToggleState())
+            resynthesizeStems();
+    };
 
 
     progressThread.progress = std::make_unique<juce::ProgressBar>(progressThread.currentPercentage);
@@ -420,6 +400,11 @@ DrumsDemixEditor::~DrumsDemixEditor()
 {
 
     DBG("chiudo...");
+    audioProcessor.modelSession.removeChangeListener(this);
+
+    // a separation in progress stops at the next chunk it writes
+    separationThread.stopThread(-1);
+
     audioProcessor.transportProcessorMusic.releaseResources();
     audioProcessor.transportProcessorMusic.setSource(nullptr);
     delete thumbnailMusic;
@@ -610,6 +595,11 @@ void DrumsDemixEditor::resized()
 
     //Separete
     testButton.setBounds(getWidth() / 2, 5, getWidth() / 2, (getHeight() - 70) / 9);  
+    modelStatusLabel.setBounds(getWidth() / 2, 5 + (getHeight() - 70) / 9, getWidth() / 2, 14);
+    liveModeButton.setBounds(10, 5 + (getHeight() - 70) / 9, 60, 14);
+    liveStemBox.setBounds(75, 5 + (getHeight() - 70) / 9, 110, 14);
+    wienerButton.setBounds(195, 5 + (getHeight() - 70) / 9, 70, 14);
+    wienerSlider.setBounds(265, 5 + (getHeight() - 70) / 9, 140, 14);
 
 
     //MUSIC SOURCE
@@ -683,163 +673,37 @@ void DrumsDemixEditor::resized()
 }
 
 
-juce::AudioBuffer<float> DrumsDemixEditor::getAudioBufferFromFile(juce::File file)
-{
-    //juce::AudioFormatManager formatManager - declared in header...`;
-    auto* reader = formatManager.createReaderFor(file);
-    juce::AudioBuffer<float> audioBuffer;
-    audioBuffer.setSize(reader->numChannels, reader->lengthInSamples);
-    reader->read(&audioBuffer, 0, reader->lengthInSamples, 0, true, true);
-    delete reader;
-    return audioBuffer;
-
-}
-
 void DrumsDemixEditor::buttonClicked(juce::Button* btn)
 {
+    if (btn == &liveModeButton) {
 
-    if (btn == &testButton) {
-
-        addAndMakeVisible(progressThread.progress.get());
-        progressThread.startThread();
-        repaint();
-        MessageManager::getInstance()->runDispatchLoopUntil(500);
-
-        //progressThread.startThread();
-
-
-        //auto begin = std::chrono::high_resolution_clock::now();
-        //***TAKE THE INPUT FROM THE MIXED DRUMS FILE***
-
-
-        //-From Wav to AudiofileBuffer
+        audioProcessor.setLiveMode(liveModeButton.getToggleState());
+        return;
+    }
 
+    if (btn == &wienerButton) {
 
-        Utils utils = Utils();
-        juce::AudioBuffer<float> fileAudiobuffer = getAudioBufferFromFile(myFile);
+        resynthesizeStems();
+        return;
+    }
 
-        DBG("number of samples, audiobuffer");
-        DBG(fileAudiobuffer.getNumSamples());
-        //torch::Tensor fileTensor; declered in .h
+    if (btn == &testButton) {
 
-        if (musicSep == true)
+        //the models load in the background, if they are not ready yet the job waits for them
+        if (audioProcessor.modelSession.isReady())
         {
-
-            std::vector<torch::Tensor> musicSeparation = musicSourceSeparation(fileAudiobuffer);
-            fileTensor = torch::cat({ musicSeparation[0], musicSeparation[1] }, 0);
-            DBG("audio tensor dim 0");
-            DBG(fileTensor.sizes()[0]);
-
-            DBG("audio tensor dim 1");
-            DBG(fileTensor.sizes()[1]);
-            yDrums = fileTensor;
-
-
-        }
-        else {
-
-            const float* readPointer1 = fileAudiobuffer.getReadPointer(0);
-            const float* readPointer2 = fileAudiobuffer.getReadPointer(1);
-
-            auto options = torch::TensorOptions().dtype(torch::kFloat32);
-
-
-            //-From a stereo AudioBuffer to a 2D Tensor
-            torch::Tensor fileTensor1 = torch::from_blob((float*)readPointer1, { 1, fileAudiobuffer.getNumSamples() }, options);
-            torch::Tensor fileTensor2 = torch::from_blob((float*)readPointer2, { 1, fileAudiobuffer.getNumSamples() }, options);
-
-            fileTensor = torch::cat({ fileTensor1, fileTensor2 }, 0);
-
+            runSeparation();
         }
-        
-
-  
-        torch::Tensor stftFilePhase;
-
-        //need to pass the stftPhase tensor in order to have it back in return
-        torch::Tensor stftFileMag = utils.batch_stft(fileTensor, stftFilePhase);
-
-        printTensorShape(stftFileMag, "stftFileMag");
-
-        stftFileMag = torch::unsqueeze(stftFileMag, 0);
-
-        printTensorShape(stftFileMag, "stftFileMag");
-
-
-        //stftFilePhase = torch::unsqueeze(stftFilePhase, 0);
-
-        DBG("stftFileMag sizes: ");
-        DBG(stftFileMag.sizes()[0]);
-        DBG(stftFileMag.sizes()[1]);
-        DBG(stftFileMag.sizes()[2]);
-        DBG(stftFileMag.sizes()[3]);
-
-
-        DBG("stftFilePhase sizes: ");
-        DBG(stftFilePhase.sizes()[0]);
-        DBG(stftFilePhase.sizes()[1]);
-        DBG(stftFilePhase.sizes()[2]);
-        //DBG(stftFilePhase.sizes()[3]);
-
-
-        //-From stft Tensor to IValue
-        std::vector<torch::jit::IValue> my_input;
-        my_input.push_back(stftFileMag);
-
-
-        //***INFER THE MODEL***
-
-
-
-        InferModels(my_input, stftFilePhase, fileTensor.sizes()[1]);
-
-        progressThread.startThread();
-        repaint();
-        MessageManager::getInstance()->runDispatchLoopUntil(500);
-
-
-
-
-        //***CREATE A STEREO, AUDIBLE OUTPUT***
-
-        // DECOMMENT IF USING ONLY THE KICK FOR QUICK DEBUGGING
-        //CreateWavQuick(yKick);
-
-
-        std::vector<at::Tensor> tensorList;
-        // DECOMMENT IF USING ALL THE DRUMS
-        if (musicSep == true){
-            tensorList = { yKick, ySnare, yToms, yHihat, yCymbals, yDrums };
+        else if (audioProcessor.modelSession.getState() == ModelSession::State::failed)
+        {
+            updateModelStatus();
         }
         else
         {
-            tensorList = { yKick, ySnare, yToms, yHihat, yCymbals };
-
+            separationQueued = true;
+            testButton.setEnabled(false);
+            updateModelStatus();
         }
-        CreateWav(tensorList, inputFileName.dropLastCharacters(4));
-
-        progressThread.startThread();
-        repaint();
-        MessageManager::getInstance()->runDispatchLoopUntil(500);
-
-
-        //auto end = std::chrono::high_resolution_clock::now();
-        //auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin);
-
-        //DBG("TEMPO MISURATO (in ms): ");
-        //DBG(std::to_string(elapsed.count()));
-
-        //textLabel.setText(std::to_string(elapsed.count()), juce::dontSendNotification);
-
-        //playKickButton.setEnabled(true);
-        //playSnareButton.setEnabled(true);
-        //playTomsButton.setEnabled(true);
-        //playHihatButton.setEnabled(true);
-        //playCymbalsButton.setEnabled(true);
-
-        progressThread.progress.get()->setVisible(false);
-        progressThread.currentPercentage = 0;
-
 
     }
     if (btn == &openMusicButton) {
@@ -868,7 +732,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
 
                 std::unique_ptr<juce::AudioFormatReaderSource> tempSource(new juce::AudioFormatReaderSource(reader, true));
 
-                audioProcessor.transportProcessorMusic.setSource(tempSource.get());
+                audioProcessor.transportProcessorMusic.setSource(tempSource.get(), 0, nullptr, reader->sampleRate);
                 transportStateChanged(Stopped, "input");
 
                 playSource.reset(tempSource.get());
@@ -938,7 +802,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
 
                 std::unique_ptr<juce::AudioFormatReaderSource> tempSource(new juce::AudioFormatReaderSource(reader, true));
 
-                audioProcessor.transportProcessor.setSource(tempSource.get());
+                audioProcessor.transportProcessor.setSource(tempSource.get(), 0, nullptr, reader->sampleRate);
                 transportStateChanged(Stopped, "input");
 
                 playSource.reset(tempSource.get());
@@ -982,7 +846,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(yDrums, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_drums.wav");
+            saveStem("_Drums.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_drums.wav");
 
 
         }
@@ -996,7 +860,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(yKick, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_kick.wav");
+            saveStem("_kick.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_kick.wav");
 
 
         }
@@ -1010,7 +874,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(ySnare, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_snare.wav");
+            saveStem("_snare.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_snare.wav");
 
 
         }
@@ -1024,7 +888,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(yToms, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_toms.wav");
+            saveStem("_toms.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_toms.wav");
 
 
         }
@@ -1038,7 +902,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(yHihat, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_hihats.wav");
+            saveStem("_hihat.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_hihats.wav");
 
 
         }
@@ -1052,7 +916,7 @@ void DrumsDemixEditor::buttonClicked(juce::Button* btn)
         if (chooser.browseForDirectory())
         {
             DBG(chooser.getResult().getFullPathName());
-            CreateWavQuick(yCymbals, chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_cymbals.wav");
+            saveStem("_cymbals.wav", chooser.getResult().getFullPathName(), inputFileName.dropLastCharacters(4) + "_cymbals.wav");
 
 
         }
@@ -1448,13 +1312,28 @@ void DrumsDemixEditor::transportStateChanged(TransportState newState, juce::Stri
 }
 
 
-void DrumsDemixEditor::displayOut(juce::AudioBuffer<float>& buffer, juce::AudioThumbnail& thumbnailOut)
+void DrumsDemixEditor::updateModelStatus()
 {
-    //juce::MemoryAudioSource input(buffer, true, false);
-    //std::this_thread::sleep_for(std::chrono::milliseconds(10000));
-
-    thumbnailOut.reset(buffer.getNumChannels(), 44100, buffer.getNumSamples());
-    thumbnailOut.addBlock(0, buffer, 0, buffer.getNumSamples());
+    switch (audioProcessor.modelSession.getState())
+    {
+    case ModelSession::State::idle:
+    case ModelSession::State::loading:
+        modelStatusLabel.setText(separationQueued ? "Models loading... separation queued" : "Models loading...", juce::dontSendNotification);
+        modelStatusLabel.setColour(juce::Label::textColourId, juce::Colours::orange);
+        break;
+    case ModelSession::State::ready:
+        modelStatusLabel.setText("Models ready", juce::dontSendNotification);
+        modelStatusLabel.setColour(juce::Label::textColourId, juce::Colours::lightgreen);
+        break;
+    case ModelSession::State::failed:
+        modelStatusLabel.setText("Models failed to load: " + audioProcessor.modelSession.getLoadError(), juce::dontSendNotification);
+        modelStatusLabel.setColour(juce::Label::textColourId, juce::Colours::red);
+
+        // nothing is waiting for the models any more, a new click shows the error again
+        separationQueued = false;
+        testButton.setEnabled(myFile.existsAsFile() && !separationThread.isThreadRunning());
+        break;
+    }
 }
 
 
@@ -1469,6 +1348,19 @@ void DrumsDemixEditor::changeListenerCallback(juce::ChangeBroadcaster* source)
     if (source == thumbnailHihatOut) { repaint(); }
     if (source == thumbnailCymbalsOut) { repaint(); }
 
+    if (source == &audioProcessor.modelSession)
+    {
+        updateModelStatus();
+
+        // runSeparation() only starts the separation thread, the message thread isn't held up
+        if (separationQueued && audioProcessor.modelSession.isReady())
+        {
+            separationQueued = false;
+            testButton.setEnabled(true);
+            runSeparation();
+        }
+    }
+
 
     if (source == &audioProcessor.transportProcessor)
     {
@@ -1638,8 +1530,8 @@ void DrumsDemixEditor::paintCursorMusic(juce::Graphics& g, const juce::Rectangle
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorMusic.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorMusic.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
 
     g.drawLine(drawPosition,  thumbnailStartPoint, drawPosition,
          thumbnailStartPoint + thumbnailHeight, 1.0f);
@@ -1650,8 +1542,8 @@ void DrumsDemixEditor::paintCursorInput(juce::Graphics& g, const juce::Rectangle
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessor.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessor.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
 
     g.drawLine(drawPosition,  10 + thumbnailStartPoint + thumbnailHeight, drawPosition,
          10 + thumbnailStartPoint + thumbnailHeight*2, 1.0f);
@@ -1662,8 +1554,8 @@ void DrumsDemixEditor::paintCursorKick(juce::Graphics& g, const juce::Rectangle<
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorKick.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorKick.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
     g.drawLine(drawPosition, 20 + thumbnailStartPoint + thumbnailHeight*2, drawPosition,
         20 + thumbnailStartPoint + thumbnailHeight*3, 1.0f);
 }
@@ -1673,8 +1565,8 @@ void DrumsDemixEditor::paintCursorSnare(juce::Graphics& g, const juce::Rectangle
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorSnare.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorSnare.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
     g.drawLine(drawPosition, 30 + thumbnailStartPoint + thumbnailHeight*3, drawPosition,
         30 + thumbnailStartPoint + thumbnailHeight*4, 1.0f);
 }
@@ -1684,8 +1576,8 @@ void DrumsDemixEditor::paintCursorToms(juce::Graphics& g, const juce::Rectangle<
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorToms.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorToms.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
     g.drawLine(drawPosition, 40 + thumbnailStartPoint + thumbnailHeight*4, drawPosition,
         40 + thumbnailStartPoint + thumbnailHeight*5, 1.0f);
 }
@@ -1695,8 +1587,8 @@ void DrumsDemixEditor::paintCursorHihat(juce::Graphics& g, const juce::Rectangle
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorHihat.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorHihat.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
     g.drawLine(drawPosition, 50 + thumbnailStartPoint + thumbnailHeight*5, drawPosition,
         50 + thumbnailStartPoint + thumbnailHeight*6, 1.0f);
 }
@@ -1706,8 +1598,8 @@ void DrumsDemixEditor::paintCursorCymbals(juce::Graphics& g, const juce::Rectang
     float thumbnailHeight = (getHeight() - 70 - 200) / 5;
     float thumbnailStartPoint = ((getHeight() - 70) / 9) + 20;
     g.setColour(juce::Colours::lightgrey);
-    auto audioPosition = (float)audioProcessor.transportProcessorCymbals.getNextReadPosition();
-    auto drawPosition = (audioPosition / audioLength) * (float)thumbnailBounds.getWidth() + (float)thumbnailBounds.getX();
+    auto audioPosition = (double)audioProcessor.transportProcessorCymbals.getNextReadPosition();
+    auto drawPosition = (float)(audioPosition / (double)audioLength * thumbnailBounds.getWidth()) + (float)thumbnailBounds.getX();
     g.drawLine(drawPosition, 60 + thumbnailStartPoint + thumbnailHeight*6, drawPosition,
         60 + thumbnailStartPoint + thumbnailHeight*7, 1.0f);
 }
@@ -1769,7 +1661,7 @@ void DrumsDemixEditor::loadFile(const juce::String& path)
 
         std::unique_ptr<juce::AudioFormatReaderSource> tempSource(new juce::AudioFormatReaderSource(reader, true));
 
-        audioProcessor.transportProcessor.setSource(tempSource.get());
+        audioProcessor.transportProcessor.setSource(tempSource.get(), 0, nullptr, reader->sampleRate);
         transportStateChanged(Stopped, "input");
 
         playSource.reset(tempSource.get());
@@ -1785,402 +1677,290 @@ void DrumsDemixEditor::loadFile(const juce::String& path)
 
 }
 
-void DrumsDemixEditor::InferModels(std::vector<torch::jit::IValue> my_input, torch::Tensor phase, int size)
-{
-    //c10::InferenceMode guard(true);
-    DBG("Infering the Models...");
-    Utils utils = Utils();
-    //***INFER THE MODEL***
-
-
-        //-Forward
-    at::Tensor outputsKick = mymoduleKick.forward(my_input).toTensor();
-
-    // COMMENTA PER AUMENTARE LA RUNTIME SPEED PER QUICK DEBUGGING
-    at::Tensor outputsSnare = mymoduleSnare.forward(my_input).toTensor();
-    at::Tensor outputsToms = mymoduleToms.forward(my_input).toTensor();
-    at::Tensor outputsHihat = mymoduleHihat.forward(my_input).toTensor();
-    at::Tensor outputsCymbals = mymoduleCymbals.forward(my_input).toTensor();
-
-    //-Need another dimension to do batch_istft
-    outputsKick = torch::squeeze(outputsKick, 0);
-
-    DBG("outputs sizes: ");
-    DBG(outputsKick.sizes()[0]);
-    DBG(outputsKick.sizes()[1]);
-    DBG(outputsKick.sizes()[2]);
-    //DBG(outputs.sizes()[3]);
-
-    progressThread.startThread();
-    repaint();
-    MessageManager::getInstance()->runDispatchLoopUntil(500);
-
-
-
-
-    // COMMENTA PER AUMENTARE LA RUNTIME SPEED PER QUICK DEBUGGING
-    outputsSnare = torch::squeeze(outputsSnare, 0);
-    outputsToms = torch::squeeze(outputsToms, 0);
-    outputsHihat = torch::squeeze(outputsHihat, 0);
-    outputsCymbals = torch::squeeze(outputsCymbals, 0);
-
+// transport ids of the stems, in ModelSession::Stem order
+static const char* stemIds[] = { "kick", "snare", "tom", "hihat", "cymbals" };
 
+void DrumsDemixEditor::runSeparation()
+{
+    startSeparation(false);
+}
 
+void DrumsDemixEditor::resynthesizeStems()
+{
+    if (separatedFile == juce::File() || separatedFile != myFile)
+        return;
 
-    //-Compute ISTFT
+    startSeparation(true);
+}
 
-    yKick = utils.batch_istft(outputsKick, phase, size);
+void DrumsDemixEditor::startSeparation(bool resynthesize)
+{
+    if (separationThread.isThreadRunning())
+        return;
 
-    DBG("y tensor sizes: ");
-    DBG(yKick.sizes()[0]);
-    DBG(yKick.sizes()[1]);
+    // the input file is only ever read in blocks, with 64-bit positions
+    std::unique_ptr<ReaderSampleSource> fileSource = ReaderSampleSource::open(formatManager, myFile);
+    if (fileSource == nullptr)
+    {
+        DBG("Failed to create reader for audio file.");
+        return;
+    }
 
+    const juce::String name = inputFileName.dropLastCharacters(4);
 
-    // COMMENTA PER AUMENTARE LA RUNTIME SPEED PER QUICK DEBUGGING
+    // a re-synthesis only writes the stems again, the drums of the separation stay as they are
+    separationJob.source = std::move(fileSource);
+    separationJob.resynthesize = resynthesize;
+    separationJob.inputFile = myFile;
+    separationJob.extractDrums = musicSep && !resynthesize;
+    separationJob.wienerExponent = wienerButton.getToggleState() ? static_cast<float>(wienerSlider.getValue()) : 0.0f;
+    separationJob.drumsFile = separationJob.extractDrums ? filesDir.getChildFile(name + "_Drums.wav") : juce::File();
 
-    ySnare = utils.batch_istft(outputsSnare, phase, size);
-    yToms = utils.batch_istft(outputsToms, phase, size);
-    yHihat = utils.batch_istft(outputsHihat, phase, size);
-    yCymbals = utils.batch_istft(outputsCymbals, phase, size);
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        separationJob.stemFiles[i] = filesDir.getChildFile(name + "_" + ModelSession::getStemName(static_cast<ModelSession::Stem>(i)) + ".wav");
 
-    progressThread.startThread();
-    repaint();
-    MessageManager::getInstance()->runDispatchLoopUntil(500);
+    // the files of the last separation are written again, nothing may keep them open
+    for (const char* id : stemIds)
+        releaseSeparatedFile(id);
 
+    if (separationJob.extractDrums)
+        releaseSeparatedFile("input");
 
-    /// RELOADARE I MODELLI E' UN MODO PER NON FAR CRASHARE AL SECONDO SEPARATE CONSECUTIVO, MA FORSE NON IL MIGLIOR MODO! (RALLENTA UN PO')
+    // the cache is written again by a separation, it holds nothing to re-synthesize until it's done
+    if (!resynthesize)
+        separatedFile = juce::File();
 
+    testButton.setEnabled(false);
+    separationProgress = 0.0;
+    addAndMakeVisible(progressThread.progress.get());
+    progressThread.progress->setVisible(true);
 
-    try {
-        //mymoduleKick=torch::jit::load("../src/scripted_modules/my_scripted_module_kick.pt");
-        //juce::String kickString = modelsDir.getFullPathName() + "/my_scripted_module_kick.pt";
-        //mymoduleKick = torch::jit::load(kickString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_kick_pt, BinaryData::my_scripted_module_kick_ptSize);
-        mymoduleKick = torch::jit::load(modelStream);
-        //MemoryInputStream* input = new MemoryInputStream(BinaryData::my_scripted_module_kick_pt, BinaryData::my_scripted_module_kick_ptSize, false);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
+    separationThread.startThread();
+}
 
+void DrumsDemixEditor::SeparationThread::run()
+{
+    juce::String error;
 
-    try {
-        //mymoduleSnare=torch::jit::load("../src/scripted_modules/my_scripted_module_snare.pt");
-        //juce::String snareString = modelsDir.getFullPathName() + "/my_scripted_module_snare.pt";
-        //mymoduleSnare = torch::jit::load(snareString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_snare_pt, BinaryData::my_scripted_module_snare_ptSize);
-        mymoduleSnare = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
+    try
+    {
+        editor.separateToFiles(editor.separationJob);
     }
-
-    try {
-        //mymoduleToms=torch::jit::load("../src/scripted_modules/my_scripted_module_toms.pt");
-        //juce::String tomsString = modelsDir.getFullPathName() + "/my_scripted_module_toms.pt";
-        //mymoduleToms = torch::jit::load(tomsString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_toms_pt, BinaryData::my_scripted_module_toms_ptSize);
-        mymoduleToms = torch::jit::load(modelStream);
+    catch (const std::exception& e)
+    {
+        error = e.what();
     }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
+    catch (...)
+    {
+        error = "unknown error";
     }
 
-    try {
-        //mymoduleHihat=torch::jit::load("../src/scripted_modules/my_scripted_module_hihat.pt");
-        //juce::String hihatString = modelsDir.getFullPathName() + "/my_scripted_module_hihat.pt";
-        //mymoduleHihat = torch::jit::load(hihatString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_hihat_pt, BinaryData::my_scripted_module_hihat_ptSize);
-        mymoduleHihat = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
-    }
+    // the writers are closed by now, a failed separation leaves no partial files behind
+    if (error.isNotEmpty())
+    {
+        for (const juce::File& file : editor.separationJob.stemFiles)
+            file.deleteFile();
 
-    try {
-        //mymoduleCymbals=torch::jit::load("../src/scripted_modules/my_scripted_module_cymbals.pt");
-        //juce::String cymbalsString = modelsDir.getFullPathName() + "/my_scripted_module_cymbals.pt";
-        //mymoduleCymbals = torch::jit::load(cymbalsString.toStdString());
-        std::stringstream modelStream;
-        modelStream.write(BinaryData::my_scripted_module_cymbals_pt, BinaryData::my_scripted_module_cymbals_ptSize);
-        mymoduleCymbals = torch::jit::load(modelStream);
-    }
-    catch (const c10::Error& e) {
-        DBG("error"); //indicate error to calling code
+        editor.separationJob.drumsFile.deleteFile();
     }
 
-    progressThread.startThread();
-    repaint();
-    MessageManager::getInstance()->runDispatchLoopUntil(500);
-
-
-
-
+    // the editor may be gone before the message thread gets to it
+    juce::Component::SafePointer<DrumsDemixEditor> target = safeEditor;
+    juce::MessageManager::callAsync([target, error]
+    {
+        if (target != nullptr)
+            target->separationFinished(error);
+    });
 }
 
-void DrumsDemixEditor::CreateWav(std::vector<at::Tensor> tList, juce::String name)
+void DrumsDemixEditor::separateToFiles(SeparationJob& job)
 {
-    for (at::Tensor yInstr : tList) {
-
-        DBG("y sizes: ");
-        DBG(yInstr.sizes()[0]);
-        DBG(yInstr.sizes()[1]);
-
-
-        //-Split output tensor in Left & Right
-        torch::autograd::variable_list ySplit = torch::split(yInstr, 1);
-        at::Tensor yL = ySplit[0];
-        at::Tensor yR = ySplit[1];
-
-
-
-        //-Make a std vector for every channel (L & R)
-        yL = yL.contiguous();
-        std::vector<float> vectoryL(yL.data_ptr<float>(), yL.data_ptr<float>() + yL.numel());
-
-        yR = yR.contiguous();
-        std::vector<float> vectoryR(yR.data_ptr<float>(), yR.data_ptr<float>() + yR.numel());
-
-        //-Create an array of 2 float pointers from the 2 std vectors 
-        float* dataPtrs[2];
-        dataPtrs[0] = { vectoryL.data() };
-        dataPtrs[1] = { vectoryR.data() };
-
-
-        //-Create the stereo AudioBuffer
-        juce::AudioBuffer<float> bufferY = juce::AudioBuffer<float>(dataPtrs, 2, yInstr.sizes()[1]);
-
-        //-Create Source
-        std::unique_ptr<juce::MemoryAudioSource> memSourcePtr(new juce::MemoryAudioSource(bufferY, true, false));
-
-        //-Create Writer
-        juce::WavAudioFormat formatWav;
-        std::unique_ptr<juce::AudioFormatWriter> writerY;
-        juce::File outFile;
-
-        if (torch::equal(yInstr, yKick)) {
-
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_kick.wav");
-            DBG(outFile.getFullPathName());
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
-
-
-
-            audioProcessor.transportProcessorKick.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "kick");
-
-            playSourceKick.reset(memSourcePtr.get());
-            areaKick.setSrcInst(memSourcePtr.release());
-
-            displayOut(bufferY, *thumbnailKickOut);
-        }
-
-        else if (torch::equal(yInstr, ySnare)) {
-
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_snare.wav");
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
-
-
-            audioProcessor.transportProcessorSnare.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "snare");
-
-            playSourceSnare.reset(memSourcePtr.get());
-            areaSnare.setSrcInst(memSourcePtr.release());
-
-            displayOut(bufferY, *thumbnailSnareOut);
-
-        }
-
-        else if (torch::equal(yInstr, yToms)) {
-
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_toms.wav");
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
-
-
-            audioProcessor.transportProcessorToms.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "tom");
-
-
-            playSourceToms.reset(memSourcePtr.get());
-            areaToms.setSrcInst(memSourcePtr.release());
-
-            displayOut(bufferY, *thumbnailTomsOut);
-        }
+    ReaderSampleSource& fileSource = *job.source;
 
-        else if (torch::equal(yInstr, yHihat)) {
+    // the models only know 44.1 kHz, other rates are resampled as the file is read
+    const double fileRate = fileSource.getSampleRate();
+    const juce::int64 fileLength = fileSource.getNumSamples();
 
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_hihat.wav");
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
+    std::unique_ptr<ResampledSampleSource> modelRateSource;
+    if (fileRate != ModelSession::sampleRate)
+        modelRateSource = std::make_unique<ResampledSampleSource>(fileSource, ModelSession::sampleRate);
 
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
+    SampleSource& input = modelRateSource != nullptr ? static_cast<SampleSource&>(*modelRateSource) : fileSource;
 
+    // one writer per stem, the separated audio is appended chunk by chunk
+    std::array<std::unique_ptr<juce::AudioFormatWriter>, ModelSession::numStems> writers;
+    juce::WavAudioFormat formatWav;
 
-            audioProcessor.transportProcessorHihat.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "hihat");
-
-
-            playSourceHihat.reset(memSourcePtr.get());
-            areaHihat.setSrcInst(memSourcePtr.release());
-
-            displayOut(bufferY, *thumbnailHihatOut);
-        }
-
-        else if (torch::equal(yInstr, yCymbals)) {
-
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_cymbals.wav");
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
-
-
-            audioProcessor.transportProcessorCymbals.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "cymbals");
-
+    auto createWriter = [fileRate, &formatWav](const juce::File& file)
+    {
+        file.deleteFile();
+        return std::unique_ptr<juce::AudioFormatWriter>(formatWav.createWriterFor(new juce::FileOutputStream(file), fileRate, 2, 16, {}, 0));
+    };
 
-            playSourceCymbals.reset(memSourcePtr.get());
-            areaCymbals.setSrcInst(memSourcePtr.release());
+    // every output goes back to the file's rate on its way to its writer, the drums are the last one
+    static constexpr int drumsOutput = ModelSession::numStems;
+    std::array<std::unique_ptr<PolyphaseResampler>, ModelSession::numStems + 1> resamplers;
+    std::array<juce::int64, ModelSession::numStems + 1> written{};
 
-            displayOut(bufferY, *thumbnailCymbalsOut);
+    if (modelRateSource != nullptr)
+        for (std::unique_ptr<PolyphaseResampler>& resampler : resamplers)
+            resampler = std::make_unique<PolyphaseResampler>(ModelSession::sampleRate, fileRate);
 
-        }
-        else if (torch::equal(yInstr, yDrums)) {
+    auto write = [&](int output, juce::AudioFormatWriter* writer, const torch::Tensor& audio)
+    {
+        // stops the pipeline when the editor is closed
+        if (separationThread.threadShouldExit())
+            throw std::runtime_error("Separation cancelled.");
 
-            outFile = juce::File(filesDir.getFullPathName()).getChildFile(name + "_Drums.wav");
-            writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(outFile),
-                44100.0,
-                bufferY.getNumChannels(),
-                16,
-                {},
-                0));
-            if (writerY != nullptr)
-                writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
+        // the round trip can add a sample, the files keep the input's length
+        const juce::int64 length = juce::jmin<juce::int64>(audio.size(1), fileLength - written[output]);
+        if (writer == nullptr || length <= 0)
+            return;
 
+        const AudioTensor chunk(audio);
+        writer->writeFromAudioSampleBuffer(chunk.getBuffer(), 0, static_cast<int>(length));
+        written[output] += length;
+    };
 
-            audioProcessor.transportProcessor.setSource(memSourcePtr.get());
-            transportStateChanged(Stopped, "input");
+    auto toFileRate = [&](int output, const torch::Tensor& audio)
+    {
+        return resamplers[output] != nullptr ? resamplers[output]->process(audio) : audio;
+    };
 
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        writers[i] = createWriter(job.stemFiles[i]);
 
-            playSourceDrums.reset(memSourcePtr.get());
-            areaDrums.setSrcInst(memSourcePtr.release());
+    // with musicSep, HTDemucs reads its windows from the file and LarsNet separates
+    // its drums while it works on the next ones, the drums are written as they come
+    std::unique_ptr<juce::AudioFormatWriter> drumsWriter;
+    if (job.extractDrums)
+        drumsWriter = createWriter(job.drumsFile);
 
-            displayOut(bufferY, *thumbnail);
+    auto writeStem = [&](ModelSession::Stem stem, const torch::Tensor& audio)
+    {
+        write(stem, writers[stem].get(), toFileRate(stem, audio));
+    };
 
-        }
+    auto setProgress = [this](double progress)
+    {
+        separationProgress = progress;
+    };
 
+    if (job.resynthesize)
+    {
+        // the same chunks as the separation, only synthesized with the new exponent
+        StreamingSeparator separator(audioProcessor.modelSession, audioProcessor.inferenceScheduler);
+        separator.setWienerExponent(job.wienerExponent);
+        separator.resynthesize(stemCache, writeStem, setProgress);
+    }
+    else
+    {
+        SeparationEngine::Settings settings;
+        settings.extractDrums = job.extractDrums;
+        settings.wienerExponent = job.wienerExponent;
+        settings.stemCache = &stemCache;
 
+        SeparationEngine engine(audioProcessor.modelSession, audioProcessor.inferenceScheduler);
 
-        DBG("wav scritto!");
+        const SeparationEngine::Metrics metrics = engine.run(input, settings, writeStem,
+        [&](const torch::Tensor& audio)
+        {
+            write(drumsOutput, drumsWriter.get(), toFileRate(drumsOutput, audio));
+        },
+        setProgress);
 
+        std::ostringstream report;
+        metrics.print(report);
+        DBG(report.str());
     }
 
+    if (modelRateSource != nullptr)
+    {
+        for (int i = 0; i < ModelSession::numStems; ++i)
+            write(i, writers[i].get(), resamplers[i]->finish());
 
+        write(drumsOutput, drumsWriter.get(), resamplers[drumsOutput]->finish());
+    }
 }
 
-void DrumsDemixEditor::CreateWavQuick(torch::Tensor yDownloadTensor, juce::String path, juce::String name)
+void DrumsDemixEditor::separationFinished(const juce::String& error)
 {
+    progressThread.progress->setVisible(false);
+    separationProgress = 0.0;
+    separationJob.source.reset();
+    testButton.setEnabled(true);
 
+    if (error.isNotEmpty())
+    {
+        DBG("Separation failed: " << error);
+        modelStatusLabel.setText("Separation failed: " + error, juce::dontSendNotification);
+        modelStatusLabel.setColour(juce::Label::textColourId, juce::Colours::red);
+        return;
+    }
 
-    DBG("y sizes: ");
-    DBG(yDownloadTensor.sizes()[0]);
-    DBG(yDownloadTensor.sizes()[1]);
-
-
-    juce::File file = juce::File(path).getChildFile(name);
-    DBG(file.getFullPathName());
-
-
-    //-Split output tensor in Left & Right
-    torch::autograd::variable_list ySplit = torch::split(yDownloadTensor, 1);
-    at::Tensor yL = ySplit[0];
-    at::Tensor yR = ySplit[1];
-
-
-
-    //-Make a std vector for every channel (L & R)
-    yL = yL.contiguous();
-    std::vector<float> vectoryL(yL.data_ptr<float>(), yL.data_ptr<float>() + yL.numel());
-
-    yR = yR.contiguous();
-    std::vector<float> vectoryR(yR.data_ptr<float>(), yR.data_ptr<float>() + yR.numel());
-
-    //-Create an array of 2 float pointers from the 2 std vectors 
-    float* dataPtrs[2];
-    dataPtrs[0] = { vectoryL.data() };
-    dataPtrs[1] = { vectoryR.data() };
-
+    if (!separationJob.resynthesize)
+        separatedFile = separationJob.inputFile;
 
+    if (separationJob.extractDrums)
+        loadSeparatedFile(separationJob.drumsFile, "input");
 
-    //-Create the stereo AudioBuffer
-    juce::AudioBuffer<float> bufferY = juce::AudioBuffer<float>(dataPtrs, 2, yDownloadTensor.sizes()[1]); //need to change last argument to let it be dynamic!
-    //bufferOut = juce::AudioBuffer<float>(dataPtrsOut, 2, yKickTensor.sizes()[1]);
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        loadSeparatedFile(separationJob.stemFiles[i], stemIds[i]);
+}
 
-    //-Print Wav
-    juce::WavAudioFormat formatWav;
-    std::unique_ptr<juce::AudioFormatWriter> writerY;
+DrumsDemixEditor::SeparatedPlayer DrumsDemixEditor::getSeparatedPlayer(const juce::String& id)
+{
+    if (id == "kick")
+        return { audioProcessor.transportProcessorKick, playSourceKick, areaKick, *thumbnailKickOut };
 
-    writerY.reset(formatWav.createWriterFor(new juce::FileOutputStream(file),
-        44100.0,
-        bufferY.getNumChannels(),
-        16,
-        {},
-        0));
-    if (writerY != nullptr)
-        writerY->writeFromAudioSampleBuffer(bufferY, 0, bufferY.getNumSamples());
+    if (id == "snare")
+        return { audioProcessor.transportProcessorSnare, playSourceSnare, areaSnare, *thumbnailSnareOut };
 
-    //std::unique_ptr<juce::MemoryAudioSource> memSourcePtr(new juce::MemoryAudioSource(bufferY, true, false));
+    if (id == "tom")
+        return { audioProcessor.transportProcessorToms, playSourceToms, areaToms, *thumbnailTomsOut };
 
+    if (id == "hihat")
+        return { audioProcessor.transportProcessorHihat, playSourceHihat, areaHihat, *thumbnailHihatOut };
 
-    //audioProcessor.transportProcessorKick.setSource(memSourcePtr.get());
-    //transportStateChanged(Stopped, "kick");
+    if (id == "cymbals")
+        return { audioProcessor.transportProcessorCymbals, playSourceCymbals, areaCymbals, *thumbnailCymbalsOut };
 
+    // the HTDemucs drums play in the input's place
+    return { audioProcessor.transportProcessor, playSourceDrums, areaDrums, *thumbnail };
+}
 
-    //playSourceKick.reset(memSourcePtr.get());
-    //areaKick.setSrcInst(memSourcePtr.release());
+void DrumsDemixEditor::loadSeparatedFile(const juce::File& file, const juce::String& id)
+{
+    auto* reader = formatManager.createReaderFor(file);
+    if (reader == nullptr)
+        return;
 
-    ////displayOut(juce::File("../wavs/testWavJuceKick.wav"), thumbnailKickOut);
+    std::unique_ptr<juce::AudioFormatReaderSource> fileSource(new juce::AudioFormatReaderSource(reader, true));
+    SeparatedPlayer player = getSeparatedPlayer(id);
 
-    //displayOut(bufferY,*thumbnailKickOut);
+    player.transport.setSource(fileSource.get(), 0, nullptr, reader->sampleRate);
+    transportStateChanged(Stopped, id);
 
+    player.area.setSrcInst(fileSource.get());
+    player.playSource.reset(fileSource.release());
 
-    DBG("wav scritto!");
+    player.thumbnail.setSource(new juce::FileInputSource(file));
+}
 
+void DrumsDemixEditor::releaseSeparatedFile(const juce::String& id)
+{
+    SeparatedPlayer player = getSeparatedPlayer(id);
 
+    player.transport.setSource(nullptr);
+    player.area.clearSrcInst();
+    player.playSource.reset();
+    player.thumbnail.clear();
+}
 
+void DrumsDemixEditor::saveStem(juce::String separatedName, juce::String path, juce::String name)
+{
+    // the separated stems only exist as files
+    filesDir.getChildFile(inputFileName.dropLastCharacters(4) + separatedName).copyFileTo(juce::File(path).getChildFile(name));
 }
+
 //================================= NEW Interface 
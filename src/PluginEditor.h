@@ -17,12 +17,18 @@
 #include <torch/script.h>
 #include <iostream>
 #include <cmath>
+#include <array>
+#include <atomic>
 #include <JuceHeader.h>
 
 
 
 #include "PluginProcessor.h"
 #include "ClickableArea.h"
+#include "PolyphaseResampler.h"
+#include "AudioTensor.h"
+#include "SampleSource.h"
+#include "StemCache.h"
 
 
 
@@ -52,8 +58,6 @@ public:
 
     void buttonClicked(juce::Button* btn) override;
 
-    juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file);
-    
     //juce::File Absolute = juce::File("/Users/alessandroorsatti/Documents/GitHub/DrumsDemix/drums_demix");
     juce::File absolutePath = juce::File::getCurrentWorkingDirectory().getParentDirectory();
     //juce::String Path = Absolute.getFullPathName();
@@ -65,8 +69,6 @@ public:
     void changeListenerCallback(juce::ChangeBroadcaster* source) override;
     void thumbnailChanged();
     
-    void displayOut(juce::AudioBuffer<float>& buffer, juce::AudioThumbnail& thumbnailOut);
-
     void paintIfNoFileLoaded(juce::Graphics& g, const juce::Rectangle<int>& thumbnailBounds, at::string Phrase);
 
     void paintIfFileLoaded(juce::Graphics& g, const juce::Rectangle<int>& thumbnailBounds, juce::AudioThumbnail& thumbnailWav, juce::Colour color);
@@ -91,11 +93,23 @@ public:
     void loadFile(const juce::String& path);
 
     //MODEL INFERENCE
-    void InferModels(std::vector<torch::jit::IValue> my_input, torch::Tensor phase, int size);
+    /** HTDemucs and LarsNet pipelined by a SeparationEngine, the stems go straight to
+        their files and play back from there, so memory doesn't grow with the track.
+        Returns right away, the separation runs on separationThread. */
+    void runSeparation();
+
+    /** Write the stems of the last separation again with the current Wiener setting,
+        from stemCache, without running the models. Does nothing while a separation
+        runs or when the loaded file isn't the one separated last. */
+    void resynthesizeStems();
+    void loadSeparatedFile(const juce::File& file, const juce::String& id);
+
+    /** Stop playing a separated file and close it, so it can be written again. */
+    void releaseSeparatedFile(const juce::String& id);
+    void updateModelStatus();
 
-    //CREATE WAV
-    void CreateWavQuick(torch::Tensor yKickTensor, juce::String path, juce::String name); 
-    void CreateWav(std::vector<at::Tensor> tList, juce::String name);
+    /** Save a separated stem, its file in filesDir, to path/name. */
+    void saveStem(juce::String separatedName, juce::String path, juce::String name);
 
 
 
@@ -224,12 +238,12 @@ private:
     juce::AudioFormatManager formatManager;
     std::unique_ptr<juce::AudioFormatReaderSource> playSource;
     std::unique_ptr<juce::AudioFormatReaderSource> playMusic; //NEW
-    std::unique_ptr<juce::MemoryAudioSource> playSourceKick;
-    std::unique_ptr<juce::MemoryAudioSource> playSourceSnare;
-    std::unique_ptr<juce::MemoryAudioSource> playSourceToms;
-    std::unique_ptr<juce::MemoryAudioSource> playSourceHihat;
-    std::unique_ptr<juce::MemoryAudioSource> playSourceCymbals;
-    std::unique_ptr<juce::MemoryAudioSource> playSourceDrums; //NEW
+    std::unique_ptr<juce::PositionableAudioSource> playSourceKick;
+    std::unique_ptr<juce::PositionableAudioSource> playSourceSnare;
+    std::unique_ptr<juce::PositionableAudioSource> playSourceToms;
+    std::unique_ptr<juce::PositionableAudioSource> playSourceHihat;
+    std::unique_ptr<juce::PositionableAudioSource> playSourceCymbals;
+    std::unique_ptr<juce::PositionableAudioSource> playSourceDrums; //NEW
 
     juce::File myFile;
     juce::File myFileOut;
@@ -245,28 +259,77 @@ private:
 
     void timerCallback() override
     {
+        // the separation thread only writes the atomic, the progress bar reads its copy here
+        progressThread.currentPercentage = separationProgress.load();
         repaint();
     }
     
-    //load TorchScript modules:
-    torch::jit::script::Module mymoduleKick;
-    torch::jit::script::Module mymoduleSnare;
-    torch::jit::script::Module mymoduleToms;
-    torch::jit::script::Module mymoduleHihat;
-    torch::jit::script::Module mymoduleCymbals;
-
-    //output tensors
-    at::Tensor yDrums; //NEW
-    at::Tensor yKick;
-    at::Tensor ySnare;
-    at::Tensor yToms;
-    at::Tensor yHihat;
-    at::Tensor yCymbals;
-
 
     juce::Label textLabel;
+    juce::Label modelStatusLabel;
+
+    //LIVE MODE
+    juce::ToggleButton liveModeButton{ "Live" };
+    juce::ComboBox liveStemBox;
+
+    //WIENER FILTER
+    juce::ToggleButton wienerButton{ "Wiener" };
+    juce::Slider wienerSlider;
+    bool separationQueued{ false };
+
+
+    /** What runSeparation() hands to the separation thread, only touched by the thread while it runs. */
+    struct SeparationJob
+    {
+        std::unique_ptr<ReaderSampleSource> source;
+        std::array<juce::File, ModelSession::numStems> stemFiles;
+        juce::File drumsFile; // only with musicSep
+        bool extractDrums{ true };
+        float wienerExponent{ 0.0f };
+        bool resynthesize{ false }; // from stemCache instead of the models
+        juce::File inputFile;
+    };
+
+    class SeparationThread : public juce::Thread
+    {
+    public:
+        SeparationThread(DrumsDemixEditor& e) : juce::Thread("Separation Thread"), editor(e), safeEditor(&e)
+        {
+        }
+
+        void run() override;
+
+    private:
+        DrumsDemixEditor& editor;
+        juce::Component::SafePointer<DrumsDemixEditor> safeEditor;
+    };
+
+    /** The transport, source, click area and thumbnail a separated file plays through. */
+    struct SeparatedPlayer
+    {
+        juce::AudioTransportSource& transport;
+        std::unique_ptr<juce::PositionableAudioSource>& playSource;
+        ClickableArea& area;
+        juce::AudioThumbnail& thumbnail;
+    };
+
+    SeparatedPlayer getSeparatedPlayer(const juce::String& id);
+
+    /** Shared by runSeparation() and resynthesizeStems(). */
+    void startSeparation(bool resynthesize);
+
+    /** Runs on the separation thread, writes the job's files. Throws if the separation fails or the editor closes. */
+    void separateToFiles(SeparationJob& job);
+
+    /** Back on the message thread once the job is over, error is empty if it succeeded. */
+    void separationFinished(const juce::String& error);
+
+    SeparationJob separationJob;
+    std::atomic<double> separationProgress{ 0.0 };
 
-    torch::Tensor fileTensor;
+    // the model outputs of the last separation, of separatedFile
+    StemCache stemCache;
+    juce::File separatedFile;
 
     
     
@@ -453,6 +516,7 @@ private:
     };
 
     ProgressThread progressThread;
+    SeparationThread separationThread{ *this };
     
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DrumsDemixEditor)
@@ -16,12 +16,18 @@ DrumsDemixProcessor::DrumsDemixProcessor()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
+                      #else
+                       .withInput  ("Live Input",  juce::AudioChannelSet::stereo(), false) // only read in live mode
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        )
 #endif
 {
+    // Nothing is loaded here: hosts construct the processor to scan it, and
+    // that shouldn't page in the model weights. The models are loaded and
+    // warmed up off the message thread once the plugin is actually used, see
+    // prepareToPlay() and createEditor().
 }
 
 DrumsDemixProcessor::~DrumsDemixProcessor()
@@ -94,6 +100,8 @@ void DrumsDemixProcessor::changeProgramName (int index, const juce::String& newN
 //==============================================================================
 void DrumsDemixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    modelSession.startLoading();
+
     transportProcessorMusic.prepareToPlay(samplesPerBlock, sampleRate);
     transportProcessor.prepareToPlay(samplesPerBlock, sampleRate);
     transportProcessorKick.prepareToPlay(samplesPerBlock, sampleRate); 
@@ -102,6 +110,13 @@ void DrumsDemixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     transportProcessorHihat.prepareToPlay(samplesPerBlock, sampleRate); 
     transportProcessorCymbals.prepareToPlay(samplesPerBlock, sampleRate);
 
+    // all the live mode buffers are allocated here, processBlock only copies
+    liveSeparator.prepare(samplesPerBlock, sampleRate);
+
+    if (liveMode)
+        liveSeparator.start();
+
+    setLatencySamples(liveMode ? liveSeparator.getLatencySamples() : 0);
 
 
     // Use this method as the place to do any pre-playback
@@ -113,6 +128,25 @@ void DrumsDemixProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    liveSeparator.release();
+}
+
+void DrumsDemixProcessor::setLiveMode(bool shouldBeLive)
+{
+    // the separator starts from silence every time, nothing left from the last
+    // time live mode was on plays first and the delay stays the reported one
+    liveSeparator.release();
+
+    {
+        const juce::ScopedLock sl(getCallbackLock());
+        liveSeparator.reset();
+        liveMode = shouldBeLive;
+    }
+
+    if (shouldBeLive)
+        liveSeparator.start();
+
+    setLatencySamples(shouldBeLive ? liveSeparator.getLatencySamples() : 0);
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -134,6 +168,10 @@ bool DrumsDemixProcessor::isBusesLayoutSupported (const BusesLayout& layouts) co
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+   #else
+    // the live input is optional, mono or stereo
+    if (layouts.getMainInputChannelSet().size() > 2)
+        return false;
    #endif
 
     return true;
@@ -156,6 +194,13 @@ void DrumsDemixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
+    if (liveMode)
+    {
+        liveSeparator.pushInput(buffer, totalNumInputChannels);
+        liveSeparator.popOutput(buffer);
+        return;
+    }
+
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
     // Make sure to reset the state if your inner loop is processing
@@ -190,6 +235,8 @@ bool DrumsDemixProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* DrumsDemixProcessor::createEditor()
 {
+    // the editor only shows the loading state and queues jobs until the models are ready
+    modelSession.startLoading();
     return new DrumsDemixEditor (*this);
 }
 
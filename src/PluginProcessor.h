@@ -34,6 +34,9 @@
 #include <juce_product_unlocking/juce_product_unlocking.h>
 #include <juce_video/juce_video.h>
 
+#include "SharedInference.h"
+#include "LiveSeparator.h"
+
 
 //==============================================================================
 /**
@@ -101,9 +104,26 @@ public:
     bool playToms{ false };
     bool playHihat{ false };
     bool playCymbals{ false };
+
 private:
+    /** keeps the process-wide models and scheduler alive while this instance exists */
+    juce::SharedResourcePointer<SharedInference> sharedInference;
+
+public:
+    /** models loaded once per process and shared by every instance and separation */
+    ModelSession& modelSession{ sharedInference->session };
+    /** runs every instance's jobs within one global thread budget */
+    InferenceScheduler& inferenceScheduler{ sharedInference->scheduler };
+
+    /** Separate the input live instead of playing back the offline stems. The
+        processor reports the LiveSeparator latency to the host while it's on. */
+    void setLiveMode(bool shouldBeLive);
+    bool isLiveMode() const { return liveMode.load(); }
 
+    LiveSeparator liveSeparator{ modelSession, inferenceScheduler };
 
+private:
+    std::atomic<bool> liveMode{ false };
 
       //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DrumsDemixProcessor)
@@ -0,0 +1,206 @@
+#include "PolyphaseResampler.h"
+
+#include <ATen/Parallel.h>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+
+// outputs per task when they are spread over the intra-op threads
+static constexpr int64_t outputsPerTask = 8192;
+
+// passband edge as a share of the lower Nyquist frequency, and the Kaiser window's beta (~80 dB stopband)
+static constexpr double rolloff = 0.9;
+static constexpr double kaiserBeta = 8.0;
+
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+    {
+        const double half = x / (2.0 * k);
+        term *= half * half;
+        sum += term;
+    }
+
+    return sum;
+}
+
+/** n is a multiple of 8. The eight lanes are independent, so this vectorizes without reassociating. */
+static float dotProduct(const float* a, const float* b, int n)
+{
+    float lanes[8] = {};
+
+    for (int i = 0; i < n; i += 8)
+        for (int j = 0; j < 8; ++j)
+            lanes[j] += a[i + j] * b[i + j];
+
+    return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+}
+
+PolyphaseResampler::PolyphaseResampler(double inputRate, double outputRate, int channels, int taps)
+    : numChannels(channels)
+{
+    const juce::int64 in = std::llround(inputRate);
+    const juce::int64 out = std::llround(outputRate);
+
+    if (in <= 0 || out <= 0)
+        throw std::invalid_argument("Sample rates must be positive.");
+
+    const juce::int64 divisor = std::gcd(in, out);
+    upFactor = static_cast<int>(out / divisor);
+    downFactor = static_cast<int>(in / divisor);
+    tapsPerPhase = juce::jmax(8, (taps + 7) / 8 * 8);
+
+    const int length = upFactor * tapsPerPhase;
+    delay = length / 2;
+
+    if (!isPassThrough())
+    {
+        // lowpass at the lower of the two Nyquist frequencies, in cycles per upsampled sample
+        const double cutoff = rolloff * 0.5 / juce::jmax(upFactor, downFactor);
+        const double halfLength = length / 2.0;
+        const double windowGain = 1.0 / besselI0(kaiserBeta);
+
+        std::vector<double> h(static_cast<size_t>(length));
+        double sum = 0.0;
+
+        for (int j = 0; j < length; ++j)
+        {
+            const double t = j - static_cast<double>(delay);
+            const double x = t / halfLength;
+            const double sinc = t == 0.0 ? 2.0 * cutoff
+                                         : std::sin(juce::MathConstants<double>::twoPi * cutoff * t) / (juce::MathConstants<double>::pi * t);
+
+            h[static_cast<size_t>(j)] = sinc * besselI0(kaiserBeta * std::sqrt(juce::jmax(0.0, 1.0 - x * x))) * windowGain;
+            sum += h[static_cast<size_t>(j)];
+        }
+
+        // unity gain at DC once the zeros between the input samples are accounted for
+        const double scale = upFactor / sum;
+
+        phases.resize(static_cast<size_t>(length));
+        for (int p = 0; p < upFactor; ++p)
+            for (int k = 0; k < tapsPerPhase; ++k)
+                phases[static_cast<size_t>(p * tapsPerPhase + tapsPerPhase - 1 - k)] = static_cast<float>(h[static_cast<size_t>(p + k * upFactor)] * scale);
+    }
+
+    reset();
+}
+
+torch::Tensor PolyphaseResampler::resample(const torch::Tensor& audio, double inputRate, double outputRate, int tapsPerPhase)
+{
+    if (std::llround(inputRate) == std::llround(outputRate))
+        return audio;
+
+    PolyphaseResampler resampler(inputRate, outputRate, static_cast<int>(audio.size(0)), tapsPerPhase);
+    const torch::Tensor body = resampler.process(audio);
+    return torch::cat({ body, resampler.finish() }, 1);
+}
+
+void PolyphaseResampler::reset()
+{
+    // the first outputs read up to tapsPerPhase - 1 samples before the input
+    history.assign(static_cast<size_t>(numChannels), std::vector<float>(static_cast<size_t>(tapsPerPhase - 1), 0.0f));
+    historyStart = -(tapsPerPhase - 1);
+    numInputSamples = 0;
+    nextOutput = 0;
+    finished = false;
+}
+
+juce::int64 PolyphaseResampler::getNumOutputSamples(juce::int64 numInput) const
+{
+    return (numInput * upFactor + downFactor - 1) / downFactor;
+}
+
+torch::Tensor PolyphaseResampler::process(const torch::Tensor& input)
+{
+    if (finished)
+        throw std::logic_error("PolyphaseResampler::process() after finish(), reset() it first.");
+
+    const torch::Tensor x = input.to(torch::kFloat32).contiguous();
+    jassert(x.size(0) == numChannels);
+
+    const juce::int64 count = x.size(1);
+    numInputSamples += count;
+
+    if (isPassThrough())
+    {
+        nextOutput += count;
+        return x;
+    }
+
+    const float* source = x.data_ptr<float>();
+    for (int c = 0; c < numChannels; ++c)
+        history[static_cast<size_t>(c)].insert(history[static_cast<size_t>(c)].end(), source + c * count, source + (c + 1) * count);
+
+    // output n is complete once input floor((n * downFactor + delay) / upFactor) is in
+    const juce::int64 available = numInputSamples * upFactor - delay;
+    const juce::int64 outputEnd = available > 0 ? (available + downFactor - 1) / downFactor : 0;
+
+    return render(juce::jmax(outputEnd, nextOutput));
+}
+
+torch::Tensor PolyphaseResampler::finish()
+{
+    if (finished)
+        throw std::logic_error("PolyphaseResampler::finish() called twice, reset() it first.");
+
+    finished = true;
+    const juce::int64 total = getNumOutputSamples(numInputSamples);
+
+    if (isPassThrough() || total <= nextOutput)
+        return torch::zeros({ numChannels, 0 });
+
+    // the silence after the end, as far as the last output reads
+    const juce::int64 silence = getInputIndex(total - 1) + 1 - (historyStart + static_cast<juce::int64>(history[0].size()));
+    if (silence > 0)
+        for (std::vector<float>& channel : history)
+            channel.resize(channel.size() + static_cast<size_t>(silence), 0.0f);
+
+    return render(total);
+}
+
+torch::Tensor PolyphaseResampler::render(juce::int64 outputEnd)
+{
+    const juce::int64 first = nextOutput;
+    const juce::int64 count = outputEnd - first;
+    torch::Tensor out = torch::empty({ numChannels, count });
+
+    if (count > 0)
+    {
+        float* dest = out.data_ptr<float>();
+
+        at::parallel_for(0, numChannels * count, outputsPerTask, [&](int64_t begin, int64_t end)
+        {
+            for (int64_t job = begin; job < end; ++job)
+            {
+                const int c = static_cast<int>(job / count);
+                const juce::int64 n = first + job % count;
+                const float* taps = phases.data() + static_cast<size_t>(getPhase(n)) * tapsPerPhase;
+                const float* samples = history[static_cast<size_t>(c)].data() + (getInputIndex(n) - tapsPerPhase + 1 - historyStart);
+
+                dest[job] = dotProduct(taps, samples, tapsPerPhase);
+            }
+        });
+    }
+
+    nextOutput = outputEnd;
+
+    // keep only what the next output reads from on
+    const juce::int64 drop = getInputIndex(nextOutput) - tapsPerPhase + 1 - historyStart;
+    const juce::int64 held = static_cast<juce::int64>(history[0].size());
+
+    if (drop > 0)
+    {
+        const auto length = static_cast<std::ptrdiff_t>(juce::jmin(drop, held));
+        for (std::vector<float>& channel : history)
+            channel.erase(channel.begin(), channel.begin() + length);
+
+        historyStart += length;
+    }
+
+    return out;
+}
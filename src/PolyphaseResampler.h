@@ -0,0 +1,71 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <vector>
+
+
+//==============================================================================
+/**
+    Sample rate conversion by a rational factor upFactor / downFactor with a
+    polyphase Kaiser-windowed sinc filter, e.g. 48 kHz -> 44.1 kHz is 147 / 160.
+
+    The filter is cut off just below the lower of the two Nyquist frequencies
+    and split into upFactor phases of tapsPerPhase taps, so each output sample
+    is one dot product over the input. The dot products keep eight independent
+    partial sums, which the compiler turns into SIMD multiply-adds without
+    -ffast-math. Its delay is compensated: output sample n lines up with input
+    time n * inputRate / outputRate.
+
+    process() streams: it takes the input block by block and returns whatever
+    outputs became complete, finish() flushes the rest. Together they return
+    exactly getNumOutputSamples() of the total input.
+*/
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler(double inputRate, double outputRate, int numChannels = 2, int tapsPerPhase = 48);
+
+    /** Resample a whole [C, N] signal in one go; returns it as it is if the rates match. */
+    static torch::Tensor resample(const torch::Tensor& audio, double inputRate, double outputRate, int tapsPerPhase = 48);
+
+    /** Feed [C, n] more input, returns the [C, m] outputs it completed. */
+    torch::Tensor process(const torch::Tensor& input);
+
+    /** The outputs still held back by the filter delay, as if the input were followed by silence. */
+    torch::Tensor finish();
+
+    /** Forget all the input, for a new stream. */
+    void reset();
+
+    /** Outputs for numInputSamples of input, ceil(numInputSamples * upFactor / downFactor). */
+    juce::int64 getNumOutputSamples(juce::int64 numInputSamples) const;
+
+    bool isPassThrough() const { return upFactor == downFactor; }
+    int getUpFactor() const { return upFactor; }
+    int getDownFactor() const { return downFactor; }
+    int getTapsPerPhase() const { return tapsPerPhase; }
+    int getNumChannels() const { return numChannels; }
+
+private:
+    /** Compute the outputs up to (not including) outputEnd from the buffered input. */
+    torch::Tensor render(juce::int64 outputEnd);
+
+    /** Input index of the newest sample output n reads, and the phase it uses. */
+    juce::int64 getInputIndex(juce::int64 n) const { return (n * downFactor + delay) / upFactor; }
+    int getPhase(juce::int64 n) const { return static_cast<int>((n * downFactor + delay) % upFactor); }
+
+    int upFactor;
+    int downFactor;
+    int numChannels;
+    int tapsPerPhase;
+    juce::int64 delay; // of the filter, in upsampled samples
+
+    std::vector<float> phases; // upFactor rows of tapsPerPhase taps, reversed to run along the input
+
+    std::vector<std::vector<float>> history; // per channel, the input from historyStart on
+    juce::int64 historyStart{ 0 };
+    juce::int64 numInputSamples{ 0 };
+    juce::int64 nextOutput{ 0 };
+    bool finished{ false };
+};
@@ -0,0 +1,156 @@
+#include "SampleSource.h"
+
+#include <stdexcept>
+
+
+static void copyChannel(torch::Tensor dest, const float* source, int numSamples)
+{
+    dest.copy_(torch::from_blob(const_cast<float*>(source), { numSamples }, torch::kFloat32));
+}
+
+torch::Tensor SampleSource::readTensor(juce::int64 start, int numSamples)
+{
+    torch::Tensor dest = torch::zeros({ 2, numSamples });
+    const juce::int64 available = juce::jlimit<juce::int64>(0, numSamples, getNumSamples() - start);
+
+    if (available > 0)
+    {
+        torch::Tensor valid = dest.narrow(1, 0, available);
+        read(valid, start, static_cast<int>(available));
+        AudioTensor::countCopy(2 * available * static_cast<juce::int64>(sizeof(float)));
+    }
+
+    return dest;
+}
+
+//==============================================================================
+ReaderSampleSource::ReaderSampleSource(std::unique_ptr<juce::AudioFormatReader> r, int blockSize)
+    : reader(std::move(r))
+{
+    block.setSize(juce::jmax(1, static_cast<int>(reader->numChannels)), blockSize);
+}
+
+std::unique_ptr<ReaderSampleSource> ReaderSampleSource::open(juce::AudioFormatManager& formatManager, const juce::File& file)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr)
+        return nullptr;
+
+    return std::make_unique<ReaderSampleSource>(std::move(reader));
+}
+
+void ReaderSampleSource::read(torch::Tensor& dest, juce::int64 start, int numSamples)
+{
+    const int numChannels = block.getNumChannels();
+
+    for (int done = 0; done < numSamples;)
+    {
+        const int count = juce::jmin(block.getNumSamples(), numSamples - done);
+        reader->read(&block, 0, count, start + done, true, true);
+
+        for (int ch = 0; ch < 2; ++ch)
+            copyChannel(dest[ch].narrow(0, done, count), block.getReadPointer(juce::jmin(ch, numChannels - 1)), count);
+
+        done += count;
+    }
+}
+
+//==============================================================================
+TensorSampleSource::TensorSampleSource(const torch::Tensor& a, double rate)
+    : audio(a), sampleRate(rate)
+{
+}
+
+void TensorSampleSource::read(torch::Tensor& dest, juce::int64 start, int numSamples)
+{
+    const juce::int64 numChannels = audio.size(0);
+
+    for (int ch = 0; ch < 2; ++ch)
+        dest[ch].copy_(audio[juce::jmin<juce::int64>(ch, numChannels - 1)].narrow(0, start, numSamples));
+}
+
+//==============================================================================
+BufferSampleSource::BufferSampleSource(const juce::AudioBuffer<float>& b, double rate)
+    : buffer(b), sampleRate(rate)
+{
+}
+
+void BufferSampleSource::read(torch::Tensor& dest, juce::int64 start, int numSamples)
+{
+    // an AudioBuffer is int-sized, a position inside it always fits the cast
+    jassert(start >= 0 && start + numSamples <= buffer.getNumSamples());
+    const int numChannels = juce::jmax(1, buffer.getNumChannels());
+
+    for (int ch = 0; ch < 2; ++ch)
+        copyChannel(dest[ch], buffer.getReadPointer(juce::jmin(ch, numChannels - 1), static_cast<int>(start)), numSamples);
+}
+
+//==============================================================================
+QueuedSampleSource::QueuedSampleSource(juce::int64 length, double rate, int capacity)
+    : numSamples(length), sampleRate(rate), chunks(static_cast<size_t>(capacity)), buffered(torch::zeros({ 2, 0 }))
+{
+}
+
+void QueuedSampleSource::read(torch::Tensor& dest, juce::int64 start, int count)
+{
+    if (start < bufferedStart)
+        throw std::logic_error("QueuedSampleSource can't read before its previous read.");
+
+    while (bufferedStart + buffered.size(1) < start + count)
+    {
+        torch::Tensor chunk;
+        const double begin = juce::Time::getMillisecondCounterHiRes();
+        const bool received = chunks.pop(chunk);
+        waitMs += juce::Time::getMillisecondCounterHiRes() - begin;
+
+        if (!received)
+            throw std::runtime_error("The previous stage stopped before the end of the track.");
+
+        buffered = torch::cat({ buffered, chunk }, 1);
+    }
+
+    const juce::int64 offset = start - bufferedStart;
+    dest.copy_(buffered.narrow(1, offset, count));
+
+    // nothing before this read is needed again, the next cat() lets it go
+    buffered = buffered.narrow(1, offset, buffered.size(1) - offset);
+    bufferedStart = start;
+}
+
+ResampledSampleSource::ResampledSampleSource(SampleSource& s, double rate, int block, int behind)
+    : source(s), outputRate(rate), blockSize(block), keepBehind(behind),
+      resampler(s.getSampleRate(), rate, 2),
+      numSamples(resampler.getNumOutputSamples(s.getNumSamples())),
+      buffered(torch::zeros({ 2, 0 }))
+{
+}
+
+void ResampledSampleSource::read(torch::Tensor& dest, juce::int64 start, int count)
+{
+    if (start < bufferedStart)
+        throw std::logic_error("ResampledSampleSource can't read that far before its previous reads.");
+
+    const juce::int64 inputLength = source.getNumSamples();
+
+    while (bufferedStart + buffered.size(1) < start + count && inputPosition < inputLength)
+    {
+        const int length = static_cast<int>(juce::jmin<juce::int64>(blockSize, inputLength - inputPosition));
+        torch::Tensor chunk = resampler.process(source.readTensor(inputPosition, length));
+        inputPosition += length;
+
+        if (inputPosition == inputLength)
+            chunk = torch::cat({ chunk, resampler.finish() }, 1);
+
+        buffered = torch::cat({ buffered, chunk }, 1);
+    }
+
+    if (bufferedStart + buffered.size(1) < start + count)
+        throw std::out_of_range("ResampledSampleSource read past its end.");
+
+    const juce::int64 offset = start - bufferedStart;
+    dest.copy_(buffered.narrow(1, offset, count));
+
+    const juce::int64 drop = juce::jmax<juce::int64>(0, offset - keepBehind);
+    buffered = buffered.narrow(1, drop, buffered.size(1) - drop);
+    bufferedStart += drop;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <torch/torch.h>
+#include <memory>
+
+#include "AudioTensor.h"
+#include "BoundedQueue.h"
+#include "PolyphaseResampler.h"
+
+
+//==============================================================================
+/**
+    Stereo audio read in blocks, with 64-bit sample positions, so a track
+    never has to fit in one int-sized juce::AudioBuffer. Mono sources are
+    duplicated on both channels, anything past the second channel is ignored.
+*/
+class SampleSource
+{
+public:
+    virtual ~SampleSource() = default;
+
+    virtual juce::int64 getNumSamples() const = 0;
+    virtual double getSampleRate() const = 0;
+
+    /** Fill dest ([2, numSamples], rows may be strided) with the samples from start on. */
+    virtual void read(torch::Tensor& dest, juce::int64 start, int numSamples) = 0;
+
+    /** [2, numSamples] from start on, zero past the end of the source. Counted in AudioTensor::getBytesCopied(). */
+    torch::Tensor readTensor(juce::int64 start, int numSamples);
+};
+
+//==============================================================================
+/** Pulls blocks of at most blockSize samples from an AudioFormatReader on demand. */
+class ReaderSampleSource : public SampleSource
+{
+public:
+    explicit ReaderSampleSource(std::unique_ptr<juce::AudioFormatReader> reader, int blockSize = 65536);
+
+    /** nullptr if the format manager can't open the file. */
+    static std::unique_ptr<ReaderSampleSource> open(juce::AudioFormatManager& formatManager, const juce::File& file);
+
+    juce::int64 getNumSamples() const override { return reader->lengthInSamples; }
+    double getSampleRate() const override { return reader->sampleRate; }
+    void read(torch::Tensor& dest, juce::int64 start, int numSamples) override;
+
+private:
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::AudioBuffer<float> block;
+};
+
+//==============================================================================
+/** Reads from a [C, N] tensor already in memory, e.g. the HTDemucs drums. */
+class TensorSampleSource : public SampleSource
+{
+public:
+    TensorSampleSource(const torch::Tensor& audio, double sampleRate = 44100.0);
+
+    juce::int64 getNumSamples() const override { return audio.size(1); }
+    double getSampleRate() const override { return sampleRate; }
+    void read(torch::Tensor& dest, juce::int64 start, int numSamples) override;
+
+private:
+    torch::Tensor audio;
+    double sampleRate;
+};
+
+//==============================================================================
+/** Reads from an AudioBuffer, which the caller keeps alive. */
+class BufferSampleSource : public SampleSource
+{
+public:
+    BufferSampleSource(const juce::AudioBuffer<float>& buffer, double sampleRate = 44100.0);
+
+    juce::int64 getNumSamples() const override { return buffer.getNumSamples(); }
+    double getSampleRate() const override { return sampleRate; }
+    void read(torch::Tensor& dest, juce::int64 start, int numSamples) override;
+
+private:
+    const juce::AudioBuffer<float>& buffer;
+    double sampleRate;
+};
+
+//==============================================================================
+/**
+    Samples pushed in chunks by another thread, e.g. the previous stage of a
+    SeparationEngine, through a queue of at most capacity chunks. The length is
+    known up front; read() waits until the producer has pushed far enough.
+    Reads may not start before the previous one, what's before it is dropped.
+*/
+class QueuedSampleSource : public SampleSource
+{
+public:
+    QueuedSampleSource(juce::int64 numSamples, double sampleRate, int capacity);
+
+    /** Producer side: append [2, n] samples, waiting while the queue is full. false once closed. */
+    bool push(const torch::Tensor& chunk) { return chunks.push(chunk); }
+
+    /** Wakes both sides for good; a read() past what was pushed then throws. */
+    void close() { chunks.close(); }
+
+    /** Time read() spent waiting for the producer. */
+    double getWaitMs() const { return waitMs; }
+
+    juce::int64 getNumSamples() const override { return numSamples; }
+    double getSampleRate() const override { return sampleRate; }
+    void read(torch::Tensor& dest, juce::int64 start, int numSamples) override;
+
+private:
+    juce::int64 numSamples;
+    double sampleRate;
+
+    BoundedQueue<torch::Tensor> chunks;
+    torch::Tensor buffered;
+    juce::int64 bufferedStart{ 0 };
+    double waitMs{ 0.0 };
+};
+
+//==============================================================================
+/**
+    Another source converted to outputRate with a PolyphaseResampler as it is
+    read, e.g. a 48 kHz file for models that take 44.1 kHz. The input is pulled
+    in blocks of blockSize samples and only what reads may still ask for is
+    kept: a read may start up to keepBehind samples before the furthest
+    previous one, which covers the overlapping windows of overlapAdd().
+*/
+class ResampledSampleSource : public SampleSource
+{
+public:
+    ResampledSampleSource(SampleSource& source, double outputRate, int blockSize = 65536, int keepBehind = 1 << 19);
+
+    juce::int64 getNumSamples() const override { return numSamples; }
+    double getSampleRate() const override { return outputRate; }
+    void read(torch::Tensor& dest, juce::int64 start, int numSamples) override;
+
+private:
+    SampleSource& source;
+    double outputRate;
+    int blockSize;
+    int keepBehind;
+
+    PolyphaseResampler resampler;
+    juce::int64 numSamples;
+    juce::int64 inputPosition{ 0 };
+
+    torch::Tensor buffered;
+    juce::int64 bufferedStart{ 0 };
+};
@@ -0,0 +1,289 @@
+#include "SeparationEngine.h"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+
+static double now()
+{
+    return juce::Time::getMillisecondCounterHiRes();
+}
+
+/** Thrown out of the LarsNet sink once the writer has stopped taking chunks, to stop the separator. */
+struct StageCancelled
+{
+};
+
+void SeparationEngine::Metrics::print(std::ostream& out) const
+{
+    out << "Pipeline: " << wallMs << " ms, first stems after " << firstResultMs << " ms" << std::endl;
+
+    for (const StageMetrics& stage : stages)
+    {
+        out << "  " << stage.name << ": " << stage.numChunks << " chunks, busy " << stage.busyMs << " ms ("
+            << stage.getUtilization(wallMs) * 100.0 << "%), waiting for input " << stage.inputWaitMs
+            << " ms, for output " << stage.outputWaitMs << " ms" << std::endl;
+    }
+}
+
+SeparationEngine::SeparationEngine(const ModelSession& s, InferenceScheduler& sched)
+    : session(s), scheduler(sched)
+{
+}
+
+SeparationEngine::Metrics SeparationEngine::run(SampleSource& source, const Settings& settings, const StreamingSeparator::Sink& stemSink,
+                                                const DrumsSink& drumsSink, const StreamingSeparator::ProgressCallback& progress)
+{
+    if (settings.extractDrums && !session.isDemucsLoaded())
+        throw std::runtime_error("HTDemucs model is not loaded.");
+
+    const int totalThreads = scheduler.getTotalThreads();
+    const int demucsThreads = settings.extractDrums
+        ? juce::jlimit(1, juce::jmax(1, totalThreads - 1), juce::roundToInt(totalThreads * settings.demucsThreadShare))
+        : 0;
+    const int larsNetThreads = juce::jmax(1, totalThreads - demucsThreads);
+
+    QueuedSampleSource larsNetInput(source.getNumSamples(), source.getSampleRate(), settings.queueCapacity);
+    BoundedQueue<Output> outputs(static_cast<size_t>(settings.queueCapacity * (ModelSession::numStems + 1)));
+
+    Metrics metrics;
+    metrics.stages.resize(3);
+    metrics.stages[0].name = settings.extractDrums ? "htdemucs" : "decode";
+    metrics.stages[1].name = "larsnet";
+    metrics.stages[2].name = "writer";
+
+    // only the first error is kept, closing the queues makes the other stages fail after it
+    std::exception_ptr firstError;
+    std::atomic<bool> failed{ false };
+    std::atomic<int> producersLeft{ 2 };
+
+    // the writer stops once both producers are done, or right away if one fails
+    auto closeAll = [&]
+    {
+        larsNetInput.close();
+        outputs.close();
+    };
+
+    auto fail = [&](std::exception_ptr error)
+    {
+        if (!failed.exchange(true))
+            firstError = error;
+
+        closeAll();
+    };
+
+    auto finishProducer = [&]
+    {
+        if (--producersLeft == 0)
+            outputs.close();
+    };
+
+    const double begin = now();
+
+    std::thread firstStage([&]
+    {
+        const double stageBegin = now();
+
+        try
+        {
+            if (settings.extractDrums)
+                runDemucsStage(source, settings, demucsThreads, larsNetInput, outputs, metrics.stages[0]);
+            else
+                runDecodeStage(source, settings, larsNetInput, metrics.stages[0]);
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+
+        StageMetrics& stage = metrics.stages[0];
+        stage.busyMs = now() - stageBegin - stage.inputWaitMs - stage.outputWaitMs;
+        finishProducer();
+    });
+
+    std::thread larsNetStage([&]
+    {
+        const double stageBegin = now();
+        StageMetrics& stage = metrics.stages[1];
+
+        try
+        {
+            StreamingSeparator separator(session, scheduler);
+            separator.setNumThreads(larsNetThreads);
+            separator.setWienerExponent(settings.wienerExponent);
+            separator.setStemCache(settings.stemCache);
+
+            separator.process(larsNetInput, [&](ModelSession::Stem stem, const torch::Tensor& audio)
+            {
+                const double pushBegin = now();
+                const bool open = outputs.push({ stem, audio });
+                stage.outputWaitMs += now() - pushBegin;
+
+                if (!open)
+                    throw StageCancelled();
+
+                if (stem == ModelSession::numStems - 1)
+                    ++stage.numChunks;
+            },
+            progress);
+        }
+        catch (const StageCancelled&)
+        {
+            closeAll();
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+
+        stage.inputWaitMs = larsNetInput.getWaitMs();
+        stage.busyMs = now() - stageBegin - stage.inputWaitMs - stage.outputWaitMs;
+        finishProducer();
+    });
+
+    // the writer stage runs on the calling thread, so the sinks don't need to be thread-safe
+    StageMetrics& writer = metrics.stages[2];
+
+    for (;;)
+    {
+        Output output;
+        const double popBegin = now();
+        const bool received = outputs.pop(output);
+        writer.inputWaitMs += now() - popBegin;
+
+        if (!received)
+            break;
+
+        const double writeBegin = now();
+
+        try
+        {
+            if (output.stem == Output::drums)
+            {
+                if (drumsSink)
+                    drumsSink(output.audio);
+            }
+            else
+            {
+                if (metrics.firstResultMs == 0.0)
+                    metrics.firstResultMs = writeBegin - begin;
+
+                stemSink(static_cast<ModelSession::Stem>(output.stem), output.audio);
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+            break;
+        }
+
+        writer.busyMs += now() - writeBegin;
+        ++writer.numChunks;
+    }
+
+    firstStage.join();
+    larsNetStage.join();
+    metrics.wallMs = now() - begin;
+
+    if (firstError != nullptr)
+        std::rethrow_exception(firstError);
+
+    return metrics;
+}
+
+void SeparationEngine::runDemucsStage(SampleSource& source, const Settings& settings, int numThreads, QueuedSampleSource& drums,
+                                      BoundedQueue<Output>& outputs, StageMetrics& metrics)
+{
+    c10::InferenceMode guard(true);
+
+    const OverlapAddSettings& oa = settings.demucs;
+    const juce::int64 numSamples = source.getNumSamples();
+    const std::vector<AudioWindow> layout = getWindowLayout(numSamples, oa);
+    const int numWindows = static_cast<int>(layout.size());
+    const int batchSize = oa.getBatchSize(numWindows);
+    const int fadeLength = oa.getFadeLength();
+
+    // overlapAdd() one window at a time: acc and weightSum hold the track from
+    // accStart on, everything before the next window's start is final
+    torch::Tensor acc = torch::zeros({ 2, 0 });
+    torch::Tensor weightSum = torch::zeros({ 0 });
+    juce::int64 accStart = 0;
+
+    auto emit = [&](const torch::Tensor& chunk)
+    {
+        const double pushBegin = now();
+        const bool open = drums.push(chunk) && outputs.push({ Output::drums, chunk });
+        metrics.outputWaitMs += now() - pushBegin;
+        ++metrics.numChunks;
+        return open;
+    };
+
+    for (int first = 0; first < numWindows;)
+    {
+        const int count = juce::jmin(batchSize, numWindows - first);
+
+        std::vector<torch::Tensor> batchWindows;
+        for (int i = 0; i < count; ++i)
+            batchWindows.push_back(readWindow(source, layout[first + i]));
+
+        // a failed forward fails the stage, run() rethrows it
+        const torch::Tensor output = scheduler.runDemucs(session, torch::stack(batchWindows), numThreads);
+
+        for (int b = 0; b < count; ++b)
+        {
+            const int i = first + b;
+            const AudioWindow& window = layout[i];
+            const int fadeInOffset = (i > 0) ? static_cast<int>(layout[i - 1].getEnd() - fadeLength - window.start) : 0;
+            const torch::Tensor weights = makeWindowWeights(window.length, fadeLength, i > 0, i < numWindows - 1, oa.fade, fadeInOffset);
+            const torch::Tensor drumsWindow = output[b].select(0, 0).view({ 2, window.length });
+
+            if (window.getEnd() > accStart + acc.size(1))
+            {
+                const juce::int64 growth = window.getEnd() - accStart - acc.size(1);
+                acc = torch::cat({ acc, torch::zeros({ 2, growth }) }, 1);
+                weightSum = torch::cat({ weightSum, torch::zeros({ growth }) });
+            }
+
+            // a tail shifted back over what's already final has zero weight there
+            const juce::int64 skip = juce::jmax<juce::int64>(0, accStart - window.start);
+            const juce::int64 length = window.length - skip;
+            acc.narrow(1, window.start + skip - accStart, length).add_((drumsWindow * weights).narrow(1, skip, length));
+            weightSum.narrow(0, window.start + skip - accStart, length).add_(weights.narrow(0, skip, length));
+
+            const juce::int64 finalEnd = juce::jmin(numSamples, i + 1 < numWindows ? layout[i + 1].start : numSamples);
+            if (finalEnd <= accStart)
+                continue;
+
+            const juce::int64 finalLength = finalEnd - accStart;
+            const torch::Tensor chunk = acc.narrow(1, 0, finalLength) / weightSum.narrow(0, 0, finalLength).clamp_min(1e-8f);
+
+            if (!emit(chunk))
+                return;
+
+            acc = acc.narrow(1, finalLength, acc.size(1) - finalLength);
+            weightSum = weightSum.narrow(0, finalLength, weightSum.size(0) - finalLength);
+            accStart = finalEnd;
+        }
+
+        first += count;
+    }
+}
+
+void SeparationEngine::runDecodeStage(SampleSource& source, const Settings& settings, QueuedSampleSource& input, StageMetrics& metrics)
+{
+    const juce::int64 numSamples = source.getNumSamples();
+
+    for (juce::int64 start = 0; start < numSamples; start += settings.inputBlockSize)
+    {
+        const torch::Tensor block = source.readTensor(start, static_cast<int>(juce::jmin<juce::int64>(settings.inputBlockSize, numSamples - start)));
+
+        const double pushBegin = now();
+        const bool open = input.push(block);
+        metrics.outputWaitMs += now() - pushBegin;
+        ++metrics.numChunks;
+
+        if (!open)
+            return;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+#include "MusicSourceSep.h"
+#include "SampleSource.h"
+#include "StreamingSeparator.h"
+#include "BoundedQueue.h"
+
+
+//==============================================================================
+/**
+    Separates a whole track as a pipeline instead of one stage after the other:
+
+        HTDemucs (or plain decoding) -> LarsNet (StreamingSeparator) -> writer
+
+    Each stage runs on its own thread and hands its chunks to the next one
+    through a BoundedQueue, so HTDemucs works on the next windows while LarsNet
+    separates the drums it already finished, and the stems reach the sinks
+    chunk by chunk while the models are still running. When a queue is full its
+    producer waits, which bounds memory to a few chunks per stage.
+
+    The two model stages reserve their own share of the scheduler's threads so
+    they don't oversubscribe the cores. The drums are stitched exactly as
+    overlapAdd() stitches them, so the result is the same as running
+    musicSourceSeparation() and then StreamingSeparator on the whole track.
+*/
+class SeparationEngine
+{
+public:
+    struct Settings
+    {
+        /** Run HTDemucs and separate its drums, otherwise separate the input as it is. */
+        bool extractDrums = true;
+
+        OverlapAddSettings demucs;
+
+        /** Chunks a queue holds before its producer waits. */
+        int queueCapacity = 4;
+
+        /** Share of the thread budget the HTDemucs stage reserves, LarsNet gets the rest. */
+        double demucsThreadShare = 0.5;
+
+        /** Wiener exponent of the LarsNet stage, 0 leaves each model's own magnitude (see WienerFilter). */
+        float wienerExponent = 0.0f;
+
+        /** Where the LarsNet stage records its chunks for StreamingSeparator::resynthesize(), if anywhere. */
+        StemCache* stemCache = nullptr;
+
+        /** Samples per chunk read from the input when there's no HTDemucs stage. */
+        int inputBlockSize = 1 << 19;
+    };
+
+    struct StageMetrics
+    {
+        juce::String name;
+        double busyMs{ 0.0 };
+        double inputWaitMs{ 0.0 };  // waiting on the previous stage
+        double outputWaitMs{ 0.0 }; // waiting on a full queue to the next stage
+        int numChunks{ 0 };
+
+        double getUtilization(double wallMs) const { return wallMs > 0.0 ? busyMs / wallMs : 0.0; }
+    };
+
+    struct Metrics
+    {
+        std::vector<StageMetrics> stages;
+        double wallMs{ 0.0 };
+        double firstResultMs{ 0.0 }; // until the first stem chunk reached its sink
+
+        void print(std::ostream& out) const;
+    };
+
+    /** Receives the HTDemucs drums, [2, n], in order and without gaps. */
+    using DrumsSink = std::function<void(const torch::Tensor& audio)>;
+
+    SeparationEngine(const ModelSession& session, InferenceScheduler& scheduler);
+
+    /** Separate the whole source. The sinks are called on the calling thread,
+        progress on the LarsNet one. Rethrows the first error of any stage,
+        returns where the time went otherwise (see Metrics::print()). */
+    Metrics run(SampleSource& source, const Settings& settings, const StreamingSeparator::Sink& stemSink,
+                const DrumsSink& drumsSink = {}, const StreamingSeparator::ProgressCallback& progress = {});
+
+private:
+    /** A finished chunk on its way to the writer. */
+    struct Output
+    {
+        int stem{ drums }; // a ModelSession::Stem, or drums for the HTDemucs output
+        torch::Tensor audio;
+
+        static constexpr int drums = -1;
+    };
+
+    void runDemucsStage(SampleSource& source, const Settings& settings, int numThreads, QueuedSampleSource& drums,
+                        BoundedQueue<Output>& outputs, StageMetrics& metrics);
+    void runDecodeStage(SampleSource& source, const Settings& settings, QueuedSampleSource& input, StageMetrics& metrics);
+
+    const ModelSession& session;
+    InferenceScheduler& scheduler;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+
+
+//==============================================================================
+/**
+    The models and the scheduler shared by every LARS instance in the process.
+    Hold it through a juce::SharedResourcePointer<SharedInference>: the first
+    instance creates it, the last one to go away frees the weights, and in
+    between every instance runs on the same single copy of the models and on
+    the same global thread budget.
+*/
+struct SharedInference
+{
+    ModelSession session;
+    InferenceScheduler scheduler;
+};
@@ -0,0 +1,97 @@
+#include "StemCache.h"
+
+#include <stdexcept>
+
+
+// FileInputStream::read() and FileOutputStream::write() take int sizes
+static constexpr juce::int64 maxBytesPerCall = 1 << 30;
+
+StemCache::StemCache()
+    : StemCache(juce::File::createTempFile(".stems"))
+{
+}
+
+StemCache::StemCache(const juce::File& f)
+    : file(f)
+{
+}
+
+StemCache::~StemCache()
+{
+    output.reset();
+    file.deleteFile();
+}
+
+void StemCache::reset(juce::int64 length, int framesPerChunk)
+{
+    output.reset();
+    entries.clear();
+    numSamples = length;
+    chunkFrames = framesPerChunk;
+
+    file.deleteFile();
+    output = std::make_unique<juce::FileOutputStream>(file);
+
+    if (output->failedToOpen())
+        throw std::runtime_error(("Couldn't create the stem cache " + file.getFullPathName()).toStdString());
+}
+
+void StemCache::write(const torch::Tensor& data)
+{
+    const torch::Tensor values = data.to(torch::kFloat32).contiguous();
+    const char* bytes = static_cast<const char*>(values.data_ptr());
+    const juce::int64 numBytes = values.numel() * static_cast<juce::int64>(sizeof(float));
+
+    for (juce::int64 done = 0; done < numBytes; done += maxBytesPerCall)
+        if (!output->write(bytes + done, static_cast<size_t>(juce::jmin(maxBytesPerCall, numBytes - done))))
+            throw std::runtime_error(("Couldn't write the stem cache " + file.getFullPathName()).toStdString());
+}
+
+void StemCache::append(const Chunk& chunk)
+{
+    jassert(output != nullptr);
+
+    Entry entry{ output->getPosition(), chunk.spec.size(0), chunk.spec.size(1), chunk.spec.size(2), static_cast<int>(chunk.stemMags.size()) };
+
+    write(torch::view_as_real(chunk.spec));
+    for (const torch::Tensor& stemMag : chunk.stemMags)
+        write(stemMag);
+
+    // reads open the file on their own
+    output->flush();
+    entries.push_back(entry);
+}
+
+StemCache::Chunk StemCache::read(int index) const
+{
+    jassert(juce::isPositiveAndBelow(index, getNumChunks()));
+    const Entry& entry = entries[static_cast<size_t>(index)];
+
+    juce::FileInputStream input(file);
+    if (input.failedToOpen() || !input.setPosition(entry.offset))
+        throw std::runtime_error(("Couldn't read the stem cache " + file.getFullPathName()).toStdString());
+
+    auto readTensor = [&](torch::IntArrayRef sizes)
+    {
+        torch::Tensor values = torch::empty(sizes);
+        char* bytes = static_cast<char*>(values.data_ptr());
+        const juce::int64 numBytes = values.numel() * static_cast<juce::int64>(sizeof(float));
+
+        for (juce::int64 done = 0; done < numBytes; done += maxBytesPerCall)
+        {
+            const int count = static_cast<int>(juce::jmin(maxBytesPerCall, numBytes - done));
+            if (input.read(bytes + done, count) != count)
+                throw std::runtime_error(("The stem cache " + file.getFullPathName() + " is truncated").toStdString());
+        }
+
+        return values;
+    };
+
+    Chunk chunk;
+    chunk.spec = torch::view_as_complex(readTensor({ entry.numChannels, entry.numBins, entry.numFrames, 2 }));
+
+    for (int i = 0; i < entry.numStems; ++i)
+        chunk.stemMags.push_back(readTensor({ entry.numChannels, entry.numBins, entry.numFrames }));
+
+    return chunk;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <torch/torch.h>
+#include <memory>
+#include <vector>
+
+
+//==============================================================================
+/**
+    The LarsNet outputs of a streamed separation, kept so its stems can be
+    synthesized again with other Wiener settings without running the models
+    (see StreamingSeparator::resynthesize()).
+
+    Every chunk's complex mixture spectrogram and stem magnitudes are appended
+    to a file as raw float32 and read back one chunk at a time, only their
+    offsets stay in memory. That is about 5 MB of disk per second of audio,
+    against nothing more in memory than the chunk being synthesized.
+
+    One thread writes while a separation runs, reads come after it finished.
+*/
+class StemCache
+{
+public:
+    /** Caches to a new file in the temporary directory. */
+    StemCache();
+    explicit StemCache(const juce::File& file);
+
+    /** Deletes the file. */
+    ~StemCache();
+
+    struct Chunk
+    {
+        torch::Tensor spec;                  // [C, bins, frames] complex
+        std::vector<torch::Tensor> stemMags; // [C, bins, frames] each
+    };
+
+    /** Start over for a separation of numSamples samples cut into chunks of chunkFrames STFT frames. */
+    void reset(juce::int64 numSamples, int chunkFrames);
+
+    /** Append the next chunk. Throws if the file can't be written. */
+    void append(const Chunk& chunk);
+
+    /** Chunk index, as it was appended. Throws if the file can't be read. */
+    Chunk read(int index) const;
+
+    int getNumChunks() const { return static_cast<int>(entries.size()); }
+    juce::int64 getNumSamples() const { return numSamples; }
+    int getChunkFrames() const { return chunkFrames; }
+
+private:
+    struct Entry
+    {
+        juce::int64 offset;
+        int64_t numChannels, numBins, numFrames;
+        int numStems;
+    };
+
+    void write(const torch::Tensor& data);
+
+    juce::File file;
+    std::unique_ptr<juce::FileOutputStream> output;
+    std::vector<Entry> entries;
+    juce::int64 numSamples{ 0 };
+    int chunkFrames{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StemCache)
+};
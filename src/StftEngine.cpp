@@ -0,0 +1,310 @@
+#include "StftEngine.h"
+
+#include <ATen/Parallel.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+
+// frames per task when they are spread over the intra-op threads
+static constexpr int64_t framesPerTask = 16;
+
+const StftEngine& StftEngine::get(int nFft, int hopLength)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<int, int>, std::unique_ptr<StftEngine>> engines;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::unique_ptr<StftEngine>& engine = engines[{ nFft, hopLength }];
+    if (engine == nullptr)
+        engine = std::make_unique<StftEngine>(nFft, hopLength);
+
+    return *engine;
+}
+
+StftEngine::StftEngine(int size, int hop)
+    : nFft(size), hopLength(hop), numBins(size / 2 + 1),
+      fftOrder(juce::roundToInt(std::log2(size))),
+      window(torch::hann_window(size, true, torch::TensorOptions().dtype(torch::kFloat32)))
+{
+    jassert(juce::isPowerOfTwo(size));
+
+    const float* w = window.data_ptr<float>();
+    windowSquared.resize(static_cast<size_t>(size));
+    juce::FloatVectorOperations::multiply(windowSquared.data(), w, w, size);
+}
+
+const juce::dsp::FFT& StftEngine::getThreadFft() const
+{
+    thread_local std::map<int, std::unique_ptr<juce::dsp::FFT>> ffts;
+
+    std::unique_ptr<juce::dsp::FFT>& fft = ffts[fftOrder];
+    if (fft == nullptr)
+        fft = std::make_unique<juce::dsp::FFT>(fftOrder);
+
+    return *fft;
+}
+
+int64_t StftEngine::getPaddedLength(int64_t numSamples) const
+{
+    // pad_len = (-(x.size(-1) - win_length) % hop_length) % win_length
+    int64_t mod = -(numSamples - nFft) % hopLength;
+    mod = mod < 0 ? mod + hopLength : mod;
+    return numSamples + mod % nFft;
+}
+
+torch::Tensor StftEngine::stft(const torch::Tensor& input, bool padInput, bool center) const
+{
+    const torch::Tensor x = (input.dim() == 1 ? input.unsqueeze(0) : input).to(torch::kFloat32).contiguous();
+    const int64_t numChannels = x.size(0);
+    const int64_t numSamples = x.size(1);
+
+    // samples from numSamples to length are the zeros of pad_stft_input
+    const int64_t length = padInput ? getPaddedLength(numSamples) : numSamples;
+    const int64_t offset = center ? nFft / 2 : 0;
+
+    if (offset >= length || length + 2 * offset < nFft)
+        throw std::invalid_argument("Signal too short for the STFT.");
+
+    const int64_t numFrames = 1 + (length + 2 * offset - nFft) / hopLength;
+    torch::Tensor out = torch::empty({ numChannels, numFrames, numBins, 2 });
+
+    const float* source = x.data_ptr<float>();
+    const float* w = window.data_ptr<float>();
+    float* dest = out.data_ptr<float>();
+
+    at::parallel_for(0, numChannels * numFrames, framesPerTask, [&](int64_t begin, int64_t end)
+    {
+        const juce::dsp::FFT& fft = getThreadFft();
+        std::vector<float> buffer(2 * static_cast<size_t>(nFft));
+
+        for (int64_t job = begin; job < end; ++job)
+        {
+            const float* signal = source + (job / numFrames) * numSamples;
+            const int64_t start = (job % numFrames) * hopLength - offset;
+
+            if (start >= 0 && start + nFft <= numSamples)
+            {
+                juce::FloatVectorOperations::multiply(buffer.data(), signal + start, w, nFft);
+            }
+            else
+            {
+                // reflected around the ends of the padded signal, zero past the real one
+                for (int i = 0; i < nFft; ++i)
+                {
+                    int64_t p = start + i;
+                    p = p < 0 ? -p : (p >= length ? 2 * (length - 1) - p : p);
+                    buffer[static_cast<size_t>(i)] = p < numSamples ? signal[p] * w[i] : 0.0f;
+                }
+            }
+
+            fft.performRealOnlyForwardTransform(buffer.data(), true);
+            std::copy(buffer.data(), buffer.data() + 2 * numBins, dest + job * 2 * numBins);
+        }
+    });
+
+    return torch::view_as_complex(out).transpose(1, 2);
+}
+
+void StftEngine::synthesizeFrame(const juce::dsp::FFT& fft, float* buffer, float* dest) const
+{
+    fft.performRealOnlyInverseTransform(buffer);
+    juce::FloatVectorOperations::multiply(dest, buffer, window.data_ptr<float>(), nFft);
+}
+
+torch::Tensor StftEngine::inverseFrames(const torch::Tensor& spec) const
+{
+    // [C, frames, bins, 2], one contiguous spectrum per frame
+    const torch::Tensor bins = torch::view_as_real(spec.to(torch::kComplexFloat).transpose(1, 2).contiguous());
+    const int64_t numChannels = bins.size(0);
+    const int64_t numFrames = bins.size(1);
+
+    torch::Tensor frames = torch::empty({ numChannels, numFrames, static_cast<int64_t>(nFft) });
+
+    const float* source = bins.data_ptr<float>();
+    float* dest = frames.data_ptr<float>();
+
+    at::parallel_for(0, numChannels * numFrames, framesPerTask, [&](int64_t begin, int64_t end)
+    {
+        const juce::dsp::FFT& fft = getThreadFft();
+        std::vector<float> buffer(2 * static_cast<size_t>(nFft));
+
+        for (int64_t job = begin; job < end; ++job)
+        {
+            std::copy(source + job * 2 * numBins, source + (job + 1) * 2 * numBins, buffer.data());
+            synthesizeFrame(fft, buffer.data(), dest + job * nFft);
+        }
+    });
+
+    return frames;
+}
+
+StftEngine::Mixture StftEngine::prepareMixture(const torch::Tensor& spec, const torch::Tensor& magnitude) const
+{
+    const torch::Tensor frameMagnitude = magnitude.to(torch::kFloat32).transpose(1, 2).contiguous();
+
+    Mixture mixture;
+    mixture.bins = torch::view_as_real(spec.to(torch::kComplexFloat).transpose(1, 2).contiguous());
+    mixture.inverseMagnitude = torch::where(frameMagnitude > 0.0f, frameMagnitude.reciprocal(), torch::zeros_like(frameMagnitude))
+                                   .unsqueeze(-1).expand({ -1, -1, -1, 2 }).contiguous();
+    return mixture;
+}
+
+torch::Tensor StftEngine::inverseFramesMasked(const Mixture& mixture, const torch::Tensor& stemMag) const
+{
+    return inverseFramesMasked(mixture, std::vector<torch::Tensor>{ stemMag });
+}
+
+torch::Tensor StftEngine::inverseFramesMasked(const Mixture& mixture, const std::vector<torch::Tensor>& stemMags) const
+{
+    return synthesizeStems(mixture, stemMags, true);
+}
+
+torch::Tensor StftEngine::inverseFramesWithGains(const Mixture& mixture, const std::vector<torch::Tensor>& gains) const
+{
+    return synthesizeStems(mixture, gains, false);
+}
+
+torch::Tensor StftEngine::synthesizeStems(const Mixture& mixture, const std::vector<torch::Tensor>& stemMags, bool divideByMixture) const
+{
+    const int64_t numStems = static_cast<int64_t>(stemMags.size());
+    const int64_t numChannels = mixture.bins.size(0);
+    const int64_t numFrames = mixture.bins.size(1);
+    const int64_t framesPerStem = numChannels * numFrames;
+
+    // read in place, whatever their strides: a task's frames share the cache lines of each bin
+    std::vector<torch::Tensor> stems;
+    for (const torch::Tensor& stemMag : stemMags)
+    {
+        stems.push_back(stemMag.to(torch::kFloat32));
+        jassert(stems.back().size(0) == numChannels && stems.back().size(1) == numBins && stems.back().size(2) == numFrames);
+    }
+
+    torch::Tensor frames = torch::empty({ numStems * numChannels, numFrames, static_cast<int64_t>(nFft) });
+
+    const float* mix = mixture.bins.data_ptr<float>();
+    const float* inverseMagnitude = mixture.inverseMagnitude.data_ptr<float>();
+    float* dest = frames.data_ptr<float>();
+
+    // every stem, channel and frame is one job, in the order of the output rows
+    at::parallel_for(0, numStems * framesPerStem, framesPerTask, [&](int64_t begin, int64_t end)
+    {
+        const juce::dsp::FFT& fft = getThreadFft();
+        std::vector<float> buffer(2 * static_cast<size_t>(nFft));
+        std::vector<float> gains(2 * static_cast<size_t>(numBins));
+
+        for (int64_t job = begin; job < end; ++job)
+        {
+            const torch::Tensor& stem = stems[static_cast<size_t>(job / framesPerStem)];
+            const int64_t mixJob = job % framesPerStem;
+            const int64_t binStride = stem.stride(1);
+
+            const float* bins = mix + mixJob * 2 * numBins;
+            const float* inverse = divideByMixture ? inverseMagnitude + mixJob * 2 * numBins : nullptr;
+            const float* magnitudes = stem.data_ptr<float>() + (mixJob / numFrames) * stem.stride(0) + (mixJob % numFrames) * stem.stride(2);
+
+            // the strided gather is the only scalar pass, each gain goes in twice to line up with the real and imaginary parts
+            for (int k = 0; k < numBins; ++k)
+                gains[2 * static_cast<size_t>(k)] = gains[2 * static_cast<size_t>(k) + 1] = magnitudes[k * binStride];
+
+            if (inverse != nullptr)
+                juce::FloatVectorOperations::multiply(gains.data(), inverse, 2 * numBins);
+
+            juce::FloatVectorOperations::multiply(buffer.data(), bins, gains.data(), 2 * numBins);
+
+            synthesizeFrame(fft, buffer.data(), dest + job * nFft);
+        }
+    });
+
+    return frames;
+}
+
+torch::Tensor StftEngine::istft(const torch::Tensor& spec, int64_t length, bool center) const
+{
+    return overlapAdd(inverseFrames(spec), length, center);
+}
+
+torch::Tensor StftEngine::istftMasked(const Mixture& mixture, const torch::Tensor& stemMag, int64_t length, bool center) const
+{
+    return overlapAdd(inverseFramesMasked(mixture, stemMag), length, center);
+}
+
+torch::Tensor StftEngine::istftMasked(const Mixture& mixture, const std::vector<torch::Tensor>& stemMags, int64_t length, bool center) const
+{
+    const torch::Tensor audio = overlapAdd(inverseFramesMasked(mixture, stemMags), length, center);
+    return audio.view({ static_cast<int64_t>(stemMags.size()), mixture.bins.size(0), audio.size(1) });
+}
+
+torch::Tensor StftEngine::istftWithGains(const Mixture& mixture, const std::vector<torch::Tensor>& gains, int64_t length, bool center) const
+{
+    const torch::Tensor audio = overlapAdd(inverseFramesWithGains(mixture, gains), length, center);
+    return audio.view({ static_cast<int64_t>(gains.size()), mixture.bins.size(0), audio.size(1) });
+}
+
+torch::Tensor StftEngine::overlapAdd(const torch::Tensor& frames, int64_t length, bool center) const
+{
+    // every row gets the same envelope, stems and channels alike
+    const int64_t numChannels = frames.size(0);
+    const int64_t numFrames = frames.size(1);
+
+    const int64_t fullLength = (numFrames - 1) * hopLength + nFft;
+    const int64_t offset = center ? nFft / 2 : 0;
+    const int64_t outLength = length > 0 ? length : fullLength - 2 * offset;
+    const int64_t available = juce::jlimit<int64_t>(0, outLength, fullLength - offset);
+
+    // 1 / window envelope, left at 1 where no frame reaches
+    std::vector<float> envelope(static_cast<size_t>(fullLength), 0.0f);
+    for (int64_t frame = 0; frame < numFrames; ++frame)
+        juce::FloatVectorOperations::add(envelope.data() + frame * hopLength, windowSquared.data(), nFft);
+
+    for (float& value : envelope)
+        value = value > 1e-11f ? 1.0f / value : 1.0f;
+
+    torch::Tensor acc = torch::zeros({ numChannels, fullLength });
+    torch::Tensor out = torch::zeros({ numChannels, outLength });
+
+    const float* source = frames.data_ptr<float>();
+    float* accData = acc.data_ptr<float>();
+    float* outData = out.data_ptr<float>();
+
+    at::parallel_for(0, numChannels, 1, [&](int64_t begin, int64_t end)
+    {
+        for (int64_t ch = begin; ch < end; ++ch)
+        {
+            float* channel = accData + ch * fullLength;
+
+            for (int64_t frame = 0; frame < numFrames; ++frame)
+                juce::FloatVectorOperations::add(channel + frame * hopLength, source + (ch * numFrames + frame) * nFft, nFft);
+
+            juce::FloatVectorOperations::multiply(outData + ch * outLength, channel + offset, envelope.data() + offset,
+                                                  static_cast<int>(available));
+        }
+    });
+
+    return out;
+}
+
+StftEngine::Validation StftEngine::validate(const torch::Tensor& x) const
+{
+    const int64_t numSamples = x.size(-1);
+
+    const torch::Tensor expected = torch::stft(x, nFft, hopLength, nFft, window, true, "reflect", false, true, true);
+    const torch::Tensor expectedAudio = torch::istft(expected, nFft, hopLength, nFft, window, true, false, true, numSamples, false);
+
+    Validation validation;
+    validation.stftMaxError = (stft(x) - expected).abs().max().item<double>();
+    validation.istftMaxError = (istft(expected, numSamples) - expectedAudio).abs().max().item<double>();
+
+    // a made-up stem, half the mixture's magnitude in every other bin
+    const torch::Tensor magnitude = torch::abs(expected);
+    const torch::Tensor stemMag = magnitude * 0.5f * (torch::arange(magnitude.size(1)) % 2).view({ 1, -1, 1 });
+    const torch::Tensor expectedStem = torch::istft(torch::polar(stemMag, torch::angle(expected)), nFft, hopLength, nFft, window,
+                                                    true, false, true, numSamples, false);
+
+    validation.maskedMaxError = (istftMasked(prepareMixture(expected, magnitude), stemMag, numSamples) - expectedStem).abs().max().item<double>();
+    return validation;
+}
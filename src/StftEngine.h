@@ -0,0 +1,120 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+#include <torch/torch.h>
+#include <vector>
+
+
+//==============================================================================
+/**
+    STFT and iSTFT with a periodic Hann window, computed with juce::dsp::FFT
+    instead of torch::stft / torch::istft.
+
+    The window and its square are built once per size and shared (see get()).
+    Each thread transforms with its own juce::dsp::FFT, since JUCE's fallback
+    engine (Linux, Windows without IPP) holds a lock for every transform. Frames are read straight from the signal: the reflect
+    padding of center and the zeros of Utils::pad_stft_input are resolved per
+    sample at the edges, so the signal is never copied into a padded one.
+    The frames are spread over libtorch's intra-op threads; windowing and
+    overlap-add use FloatVectorOperations, i.e. the SIMD kernels JUCE picks for
+    the platform.
+*/
+class StftEngine
+{
+public:
+    /** The shared engine for this size, created on first use. */
+    static const StftEngine& get(int nFft = 4096, int hopLength = 1024);
+
+    StftEngine(int nFft, int hopLength);
+
+    /** Same as torch::stft(x, nFft, hopLength, nFft, window, center, "reflect", false, true, true),
+        for x [C, N] float. padInput first appends the zeros Utils::pad_stft_input would.
+        Returns complex [C, nFft / 2 + 1, frames]. */
+    torch::Tensor stft(const torch::Tensor& x, bool padInput = false, bool center = true) const;
+
+    /** Same as torch::istft(spec, nFft, hopLength, nFft, window, center, false, true, length),
+        for spec complex [C, nFft / 2 + 1, frames]. length <= 0 keeps every sample. */
+    torch::Tensor istft(const torch::Tensor& spec, int64_t length = 0, bool center = true) const;
+
+    /** Windowed inverse transforms of spec [C, nFft / 2 + 1, frames], as [C, frames, nFft],
+        for callers that overlap-add themselves. */
+    torch::Tensor inverseFrames(const torch::Tensor& spec) const;
+
+    /** A mixture spectrogram laid out for masking, prepared once for all the stems. */
+    struct Mixture
+    {
+        torch::Tensor bins;             // [C, frames, nFft / 2 + 1, 2], real and imaginary parts, frame by frame
+        torch::Tensor inverseMagnitude; // [C, frames, nFft / 2 + 1, 2], 1 / |spec| twice, laid out like bins, 0 where spec is 0
+    };
+
+    /** spec [C, nFft / 2 + 1, frames] and its magnitude, e.g. the model input. */
+    Mixture prepareMixture(const torch::Tensor& spec, const torch::Tensor& magnitude) const;
+
+    /** Windowed inverse transforms of the stem with magnitude stemMag [C, nFft / 2 + 1, frames]
+        on the mixture's phase. Each bin of the mixture is scaled by stemMag / |spec| as it is
+        loaded into the FFT, so there is no angle() / polar() pass and no phase tensor. Same as
+        inverseFrames(torch::polar(stemMag, torch::angle(spec))) except where the mixture is
+        exactly 0, which stays 0. */
+    torch::Tensor inverseFramesMasked(const Mixture& mixture, const torch::Tensor& stemMag) const;
+
+    /** The same for several stems in one batch, as [stems * C, frames, nFft]. */
+    torch::Tensor inverseFramesMasked(const Mixture& mixture, const std::vector<torch::Tensor>& stemMags) const;
+
+    /** The same with real gains [C, nFft / 2 + 1, frames] applied to the mixture as they are,
+        e.g. the masks of a WienerFilter. */
+    torch::Tensor inverseFramesWithGains(const Mixture& mixture, const std::vector<torch::Tensor>& gains) const;
+
+    /** istft() of the same masked stem. */
+    torch::Tensor istftMasked(const Mixture& mixture, const torch::Tensor& stemMag, int64_t length = 0, bool center = true) const;
+
+    /** istft() of every stem in one pass, as [stems, C, length]: the frames of all the stems
+        are synthesized in parallel and share one window envelope. Each stem comes out exactly
+        as from the single-stem istftMasked(). */
+    torch::Tensor istftMasked(const Mixture& mixture, const std::vector<torch::Tensor>& stemMags, int64_t length = 0,
+                              bool center = true) const;
+
+    /** The same for inverseFramesWithGains(), as [stems, C, length]. */
+    torch::Tensor istftWithGains(const Mixture& mixture, const std::vector<torch::Tensor>& gains, int64_t length = 0,
+                                 bool center = true) const;
+
+    /** Length of x after Utils::pad_stft_input. */
+    int64_t getPaddedLength(int64_t numSamples) const;
+
+    int getFftSize() const { return nFft; }
+    int getHopLength() const { return hopLength; }
+    const torch::Tensor& getWindow() const { return window; }
+
+    /** Largest absolute differences against torch::stft and torch::istft on x [C, N]. */
+    struct Validation
+    {
+        double stftMaxError{ 0.0 };
+        double istftMaxError{ 0.0 };
+        double maskedMaxError{ 0.0 }; // istftMasked() against istft(polar(magnitude, angle(spec)))
+    };
+
+    Validation validate(const torch::Tensor& x) const;
+
+private:
+    /** Frames of every stem, the mixture scaled per bin by stem / |spec| or, without
+        divideByMixture, by stem itself. */
+    torch::Tensor synthesizeStems(const Mixture& mixture, const std::vector<torch::Tensor>& stems, bool divideByMixture) const;
+
+    /** This size's FFT for the calling thread, created on its first use there. */
+    const juce::dsp::FFT& getThreadFft() const;
+
+    /** Inverse transform of the interleaved bins in buffer, windowed into dest. */
+    void synthesizeFrame(const juce::dsp::FFT& fft, float* buffer, float* dest) const;
+
+    /** Overlap-add frames [C, frames, nFft] and divide by the window envelope. */
+    torch::Tensor overlapAdd(const torch::Tensor& frames, int64_t length, bool center) const;
+
+    int nFft;
+    int hopLength;
+    int numBins;
+    int fftOrder;
+
+    torch::Tensor window;
+    std::vector<float> windowSquared;
+
+    JUCE_DECLARE_NON_COPYABLE(StftEngine)
+};
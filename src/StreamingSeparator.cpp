@@ -0,0 +1,188 @@
+#include "StreamingSeparator.h"
+#include "InferenceBackend.h"
+#include "WienerFilter.h"
+
+#include <stdexcept>
+
+
+//==============================================================================
+void StreamingSeparator::overlapAddFrames(torch::Tensor& acc, const torch::Tensor& frames, int fftSize, int hop)
+{
+    // frames fftSize / hop apart don't overlap, so each of those groups is a single add
+    const int64_t numFrames = frames.size(1);
+    const int groups = fftSize / hop;
+
+    for (int g = 0; g < juce::jmin<int64_t>(groups, numFrames); ++g)
+    {
+        const torch::Tensor group = frames.slice(1, g, numFrames, groups);
+        const int64_t length = group.size(1) * fftSize;
+
+        acc.narrow(1, static_cast<int64_t>(g) * hop, length).add_(group.reshape({ frames.size(0), length }));
+    }
+}
+
+StreamingSeparator::StreamingSeparator(const ModelSession& s, InferenceScheduler& sched)
+    : session(s), scheduler(sched),
+      chunkFrames(LarsNetSegmentAdapter::segmentFrames),
+      threadsPerChunk(sched.getTotalThreads()),
+      stftEngine(StftEngine::get(nFft, hopLength)),
+      window(stftEngine.getWindow())
+{
+}
+
+void StreamingSeparator::setChunkFrames(int numFrames)
+{
+    // chunks must start on a segment boundary to get the same segments as the whole track
+    const int segment = LarsNetSegmentAdapter::segmentFrames;
+    chunkFrames = juce::jmax(1, (numFrames + segment - 1) / segment) * segment;
+}
+
+torch::Tensor StreamingSeparator::readCentered(SampleSource& source, int64_t centeredStart, int64_t length, int64_t paddedLength)
+{
+    // same signal as Utils::_stft of pad_stft_input: zero-padded to paddedLength, then reflect-padded by nFft / 2 on both sides
+    torch::Tensor positions = torch::arange(centeredStart - nFft / 2, centeredStart - nFft / 2 + length, torch::kLong);
+    positions = torch::where(positions < 0, -positions, positions);
+    positions = torch::where(positions >= paddedLength, 2 * (paddedLength - 1) - positions, positions);
+
+    const int64_t first = positions.min().item<int64_t>();
+    const int64_t last = positions.max().item<int64_t>() + 1;
+    const int64_t available = juce::jmin(last, source.getNumSamples()) - first;
+
+    torch::Tensor block = torch::zeros({ 2, last - first });
+
+    if (available > 0)
+    {
+        torch::Tensor dest = block.narrow(1, 0, available);
+        source.read(dest, first, static_cast<int>(available));
+    }
+
+    return block.index_select(1, positions - first);
+}
+
+int64_t StreamingSeparator::getPaddedLength(int64_t numSamples)
+{
+    int64_t mod = -(numSamples - nFft) % hopLength;
+    mod = mod < 0 ? mod + hopLength : mod;
+    return numSamples + mod % nFft;
+}
+
+void StreamingSeparator::process(SampleSource& source, const Sink& sink, const ProgressCallback& progress)
+{
+    c10::InferenceMode guard(true);
+
+    const int64_t numSamples = source.getNumSamples();
+    const int64_t paddedLength = getPaddedLength(numSamples);
+
+    if (stemCache != nullptr)
+        stemCache->reset(numSamples, chunkFrames);
+
+    synthesize(numSamples, chunkFrames, [&](int64_t firstFrame, int64_t numFrames)
+    {
+        const torch::Tensor signal = readCentered(source, firstFrame * hopLength, (numFrames - 1) * hopLength + nFft, paddedLength);
+
+        StemCache::Chunk chunk;
+        chunk.spec = stftEngine.stft(signal, false, false);
+
+        for (const torch::Tensor& output : scheduler.runStems(session, torch::abs(chunk.spec).unsqueeze(0), threadsPerChunk))
+            chunk.stemMags.push_back(output.squeeze(0));
+
+        if (stemCache != nullptr)
+            stemCache->append(chunk);
+
+        return chunk;
+    },
+    sink, progress);
+}
+
+void StreamingSeparator::resynthesize(const StemCache& cache, const Sink& sink, const ProgressCallback& progress)
+{
+    c10::InferenceMode guard(true);
+
+    synthesize(cache.getNumSamples(), cache.getChunkFrames(), [&](int64_t firstFrame, int64_t numFrames)
+    {
+        const int index = static_cast<int>(firstFrame / cache.getChunkFrames());
+        if (index >= cache.getNumChunks())
+            throw std::runtime_error("The stem cache doesn't hold the whole separation.");
+
+        StemCache::Chunk chunk = cache.read(index);
+        jassert(chunk.spec.size(2) == numFrames);
+        return chunk;
+    },
+    sink, progress);
+}
+
+void StreamingSeparator::synthesize(int64_t numSamples, int framesPerChunk, const ChunkFunction& getChunk, const Sink& sink, const ProgressCallback& progress)
+{
+    // padding of Utils::pad_stft_input, the frame count follows from it
+    const int64_t paddedLength = getPaddedLength(numSamples);
+    const int64_t numFrames = 1 + paddedLength / hopLength;
+
+    if (paddedLength <= nFft / 2)
+        throw std::runtime_error("Track too short for the STFT.");
+
+    const int overlap = nFft - hopLength;
+    std::vector<torch::Tensor> carries(ModelSession::numStems, torch::zeros({ 2, overlap }));
+    torch::Tensor envelopeCarry = torch::zeros({ 1, overlap });
+    const torch::Tensor squaredWindow = window.pow(2);
+
+    for (int64_t firstFrame = 0; firstFrame < numFrames; firstFrame += framesPerChunk)
+    {
+        const int64_t chunkFrameCount = juce::jmin<int64_t>(framesPerChunk, numFrames - firstFrame);
+        const int64_t chunkStart = firstFrame * hopLength; // in the centered signal
+        const int64_t chunkLength = (chunkFrameCount - 1) * hopLength + nFft;
+        const bool isLastChunk = firstFrame + chunkFrameCount == numFrames;
+
+        const StemCache::Chunk chunk = getChunk(firstFrame, chunkFrameCount);
+        const std::vector<torch::Tensor>& stemMags = chunk.stemMags;
+        const StftEngine::Mixture mixture = stftEngine.prepareMixture(chunk.spec, torch::abs(chunk.spec));
+
+        // window envelope of the iSTFT, the same for every stem
+        torch::Tensor envelope = torch::zeros({ 1, chunkLength });
+        envelope.narrow(1, 0, overlap).add_(envelopeCarry);
+        overlapAddFrames(envelope, squaredWindow.expand({ 1, chunkFrameCount, nFft }), nFft, hopLength);
+
+        // nothing before the next chunk's first frame changes any more
+        const int64_t finishedLength = isLastChunk ? chunkLength : chunkFrameCount * hopLength;
+        const torch::Tensor finishedEnvelope = envelope.narrow(1, 0, finishedLength).clamp_min(1e-11f);
+
+        // back to track positions, dropping the centering pad and anything past the end of the track
+        const int64_t outputBegin = juce::jmax<int64_t>(0, nFft / 2 - chunkStart);
+        const int64_t outputEnd = juce::jmin<int64_t>(finishedLength, numSamples + nFft / 2 - chunkStart);
+
+        // the frames of all five stems in one batch, [numStems * 2, frames, nFft]
+        torch::Tensor stemFrames;
+        if (wienerExponent > 0.0f)
+        {
+            const std::vector<torch::Tensor> masks = WienerFilter::computeMasks(stemMags, wienerExponent).unbind(0);
+            stemFrames = stftEngine.inverseFramesWithGains(mixture, masks);
+        }
+        else
+        {
+            stemFrames = stftEngine.inverseFramesMasked(mixture, stemMags);
+        }
+
+        for (int i = 0; i < ModelSession::numStems; ++i)
+        {
+            const torch::Tensor frames = stemFrames.narrow(0, 2 * i, 2);
+
+            torch::Tensor acc = torch::zeros({ 2, chunkLength });
+            acc.narrow(1, 0, overlap).add_(carries[i]);
+            overlapAddFrames(acc, frames, nFft, hopLength);
+
+            if (!isLastChunk)
+                carries[i] = acc.narrow(1, finishedLength, overlap).clone();
+
+            if (outputEnd > outputBegin)
+            {
+                const torch::Tensor finished = acc.narrow(1, 0, finishedLength) / finishedEnvelope;
+                sink(static_cast<ModelSession::Stem>(i), finished.narrow(1, outputBegin, outputEnd - outputBegin).contiguous());
+            }
+        }
+
+        if (!isLastChunk)
+            envelopeCarry = envelope.narrow(1, finishedLength, overlap).clone();
+
+        if (progress)
+            progress(static_cast<double>(firstFrame + chunkFrameCount) / static_cast<double>(numFrames));
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <torch/torch.h>
+#include <functional>
+
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+#include "SampleSource.h"
+#include "StftEngine.h"
+#include "StemCache.h"
+
+
+//==============================================================================
+/**
+    LarsNet separation of a whole track in bounded memory.
+
+    The track is read, transformed, separated and resynthesized 512 STFT frames
+    (one LarsNet segment) at a time: each chunk gets exactly the frames the
+    whole-track Utils::_stft would give it, goes through the five stem
+    models, and the iSTFT is overlap-added into a carry of n_fft - hop samples
+    that holds what the next chunk still adds to. Finished audio is handed to
+    the sink as soon as no later frame touches it, so peak memory depends on
+    the chunk size, not on the length of the track.
+
+    With a StemCache set, every chunk's spectrogram and model outputs are kept
+    in it, and resynthesize() runs the same chunks again from there, e.g. with
+    another Wiener exponent, without the models.
+*/
+class StreamingSeparator
+{
+public:
+    /** Receives the separated audio of one stem, [2, n], in order and without gaps. */
+    using Sink = std::function<void(ModelSession::Stem stem, const torch::Tensor& audio)>;
+
+    /** Called after every chunk with the fraction of the track done. */
+    using ProgressCallback = std::function<void(double progress)>;
+
+    static constexpr int nFft = 4096;
+    static constexpr int hopLength = 1024;
+
+    StreamingSeparator(const ModelSession& session, InferenceScheduler& scheduler);
+
+    /** Separate the whole source into sink, chunkFrames STFT frames at a time
+        (a multiple of the 512-frame LarsNet segment). */
+    void process(SampleSource& source, const Sink& sink, const ProgressCallback& progress = {});
+
+    /** The stems of the separation recorded in cache, synthesized with the current
+        Wiener exponent; the same as process() gives with it, without running the models. */
+    void resynthesize(const StemCache& cache, const Sink& sink, const ProgressCallback& progress = {});
+
+    void setChunkFrames(int numFrames);
+    int getChunkFrames() const { return chunkFrames; }
+
+    /** Threads of the scheduler's budget each chunk's stem models run with,
+        all of them by default. */
+    void setNumThreads(int numThreads) { threadsPerChunk = numThreads; }
+
+    /** Wiener-filter the stems of every chunk with this exponent (see WienerFilter), 0 turns it off. */
+    void setWienerExponent(float exponent) { wienerExponent = exponent; }
+
+    /** Record every chunk process() separates into cache (reset first), nullptr stops recording. */
+    void setStemCache(StemCache* cache) { stemCache = cache; }
+
+    /** Overlap-add frames [C, n, nFft], one every hop samples, into acc [C, >= (n - 1) * hop + nFft]. */
+    static void overlapAddFrames(torch::Tensor& acc, const torch::Tensor& frames, int fftSize, int hop);
+
+private:
+    /** The spectrogram and model outputs of the chunk of numFrames frames starting at firstFrame. */
+    using ChunkFunction = std::function<StemCache::Chunk(int64_t firstFrame, int64_t numFrames)>;
+
+    /** Length of the zero-padded signal Utils::pad_stft_input gives for numSamples. */
+    static int64_t getPaddedLength(int64_t numSamples);
+
+    /** iSTFT and overlap-add of every chunk into the sink, framesPerChunk frames at a time. */
+    void synthesize(int64_t numSamples, int framesPerChunk, const ChunkFunction& getChunk, const Sink& sink, const ProgressCallback& progress);
+
+    torch::Tensor readCentered(SampleSource& source, int64_t centeredStart, int64_t length, int64_t paddedLength);
+
+    const ModelSession& session;
+    InferenceScheduler& scheduler;
+
+    int chunkFrames;
+    int threadsPerChunk;
+    float wienerExponent{ 0.0f };
+    StemCache* stemCache{ nullptr };
+    const StftEngine& stftEngine;
+    torch::Tensor window;
+};
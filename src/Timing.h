@@ -0,0 +1,22 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <chrono>
+
+
+/** Wall time of fn() in milliseconds, best of numRuns. */
+template <typename Fn>
+double timeBestOf(int numRuns, Fn&& fn)
+{
+    using Clock = std::chrono::steady_clock;
+
+    double best = 0.0;
+    for (int run = 0; run < juce::jmax(1, numRuns); ++run)
+    {
+        auto begin = Clock::now();
+        fn();
+        const double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+        best = (run == 0) ? elapsed : juce::jmin(best, elapsed);
+    }
+    return best;
+}
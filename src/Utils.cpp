@@ -3,6 +3,8 @@
 #include <torch/torch.h>
 #include <torch/script.h>
 
+#include "StftEngine.h"
+
 
 class Utils{
     public:
@@ -14,6 +16,7 @@ class Utils{
         float power;
         bool center;
         torch::Tensor hann_win;
+        const StftEngine* engine = nullptr; // shared plan and window, when the window spans the whole FFT
     
     Utils(int _F = 0, int _T = 0, int _n_fft = 4096, int _win_length = false, int _hop_length = false, float _power = 1.0, bool _center = true){
         n_fft = _n_fft;
@@ -42,13 +45,19 @@ class Utils{
         center = _center;
         F = _F;
         T = _T;
-        hann_win = torch::hann_window(win_length, true, at::TensorOptions().dtype(at::kFloat).requires_grad(false));
+        if (win_length == n_fft && juce::isPowerOfTwo(n_fft)) {
+            engine = &StftEngine::get(n_fft, hop_length);
+            hann_win = engine->getWindow();
+        }
+        else {
+            hann_win = torch::hann_window(win_length, true, at::TensorOptions().dtype(at::kFloat).requires_grad(false));
+        }
     }
 
     torch::Tensor ourReshape(torch::Tensor x) {
         auto x_shape = x.sizes();
-        auto last = int(x_shape.back());
-        auto mult = 1;
+        auto last = x_shape.back();
+        int64_t mult = 1;
         for (auto n = 0; n < x_shape.size() - 1; n++) {
             mult = mult * x_shape[n];
         }
@@ -59,10 +68,10 @@ class Utils{
 
     torch::Tensor pad_stft_input(int win_len, int hop_len, torch::Tensor x){
         auto x_shape = x.sizes();
-        int last = int(x_shape.back());
+        int64_t last = x_shape.back();
 
         //pad_len = (-(x.size(-1) - self.win_length) % self.hop_length) % self.win_length
-        int mod = -(last - win_len) % hop_len;
+        int64_t mod = -(last - win_len) % hop_len;
         mod = mod < 0 ? mod + hop_len : mod;
         auto pad_len = (mod) % win_len;
 
@@ -83,70 +92,13 @@ class Utils{
         torch::Tensor x2 = torch::cat({ left_pad, x, right_pad }, 0);
         */
 
-        torch::Tensor y = torch::stft(x, this->n_fft, this->hop_length, this->win_length, this->hann_win, true, "reflect", false, true, true);
-
-        return y;
-    }
-
-    torch::Tensor batch_stft(torch::Tensor x, torch::Tensor& stftFilePhase, bool pad = true, bool return_complex = false){
-        //c10::IntArrayRef x_shape = x.sizes();
-        
-        //DBG("x_shape: ");
-        //DBG(x_shape[0]);
-        //DBG(x_shape[1]);
-        //DBG(x_shape[2]);
-
-
-        //x = x.reshape(-1, x_shape[-1])
-        //x = ourReshape(x);
-
-        //DBG("x after reshape");
-        //DBG(x.sizes()[0]);
-        //DBG(x.sizes()[1]);
-        //DBG(x.sizes()[2]);
-        
-        if(pad){
-            x = pad_stft_input(this->win_length, this->hop_length, x);
-        }
-
-
-        //DBG("x after pad");
-        //DBG(x.sizes()[0]);
-        //DBG(x.sizes()[1]);
-        //DBG(x.sizes()[2]);
-        
-
-        torch::Tensor S = _stft(x);
-
-
-        //c10::IntArrayRef S_shape = S.sizes();
-
-
-
-
-        if (return_complex){
-            return S;
+        if (engine != nullptr) {
+            return engine->stft(x, false, true);
         }
 
-        stftFilePhase = torch::angle(S);
-
-        return torch::abs(S);
-
-
-    }
-
-
-    torch::Tensor _istft(torch::Tensor x, int trim_length=0){
-        return torch::istft(x, this->n_fft, this->hop_length, this->win_length, this->hann_win, true, false, true, trim_length, false );
-
-    }
-
-
-    torch::Tensor batch_istft(torch::Tensor mag, torch::Tensor phase, int trim_length){
-        torch::Tensor S = torch::polar(mag, phase);
-        torch::Tensor res = _istft(S, trim_length);
-        return res;
+        torch::Tensor y = torch::stft(x, this->n_fft, this->hop_length, this->win_length, this->hann_win, true, "reflect", false, true, true);
 
+        return y;
     }
 
 };
@@ -0,0 +1,59 @@
+#include "WienerFilter.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <ATen/Parallel.h>
+#include <cmath>
+
+
+torch::Tensor WienerFilter::computeMasks(const std::vector<torch::Tensor>& stemMags, float exponent)
+{
+    const int64_t numStems = static_cast<int64_t>(stemMags.size());
+    jassert(numStems > 0);
+
+    std::vector<torch::Tensor> stems;
+    for (const torch::Tensor& stemMag : stemMags)
+        stems.push_back(stemMag.to(torch::kFloat32).contiguous());
+
+    const int64_t numRows = stems[0].size(0) * stems[0].size(1);
+    const int64_t numFrames = stems[0].size(2);
+    const int rowLength = static_cast<int>(numFrames);
+
+    torch::Tensor masks = torch::empty({ numStems, stems[0].size(0), stems[0].size(1), numFrames });
+    float* maskData = masks.data_ptr<float>();
+    const int64_t stemSize = numRows * numFrames;
+
+    at::parallel_for(0, numRows, 1, [&](int64_t begin, int64_t end)
+    {
+        std::vector<float> sum(static_cast<size_t>(numFrames));
+
+        for (int64_t row = begin; row < end; ++row)
+        {
+            juce::FloatVectorOperations::fill(sum.data(), epsilon, rowLength);
+
+            // pred^alpha goes straight into the mask rows, then gets divided by the sum in place
+            for (int64_t s = 0; s < numStems; ++s)
+            {
+                const float* pred = stems[static_cast<size_t>(s)].data_ptr<float>() + row * numFrames;
+                float* mask = maskData + s * stemSize + row * numFrames;
+
+                if (exponent == 1.0f)
+                    juce::FloatVectorOperations::copy(mask, pred, rowLength);
+                else if (exponent == 2.0f)
+                    juce::FloatVectorOperations::multiply(mask, pred, pred, rowLength);
+                else
+                    for (int64_t t = 0; t < numFrames; ++t)
+                        mask[t] = std::pow(pred[t], exponent);
+
+                juce::FloatVectorOperations::add(sum.data(), mask, rowLength);
+            }
+
+            for (float& value : sum)
+                value = 1.0f / value;
+
+            for (int64_t s = 0; s < numStems; ++s)
+                juce::FloatVectorOperations::multiply(maskData + s * stemSize + row * numFrames, sum.data(), rowLength);
+        }
+    });
+
+    return masks;
+}
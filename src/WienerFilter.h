@@ -0,0 +1,27 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <vector>
+
+
+//==============================================================================
+/**
+    Wiener post-filter over the stem estimates, as separate_wiener() in
+    net/separator.py. Stem i gets the mixture scaled by
+
+        pred_i^alpha / (sum_j pred_j^alpha + 1e-7)
+
+    instead of its own magnitude on the mixture's phase, so the stems add up
+    to the mixture. alpha = 1 splits every bin in proportion to the estimates,
+    larger exponents give harder masks.
+*/
+class WienerFilter
+{
+public:
+    static constexpr float epsilon = 1e-7f;
+
+    /** Masks [stems, C, bins, frames] for the stem magnitudes ([C, bins, frames] each), in one
+        pass over the spectrogram: the (channel, bin) rows are spread over the intra-op threads
+        and every row goes through FloatVectorOperations. */
+    static torch::Tensor computeMasks(const std::vector<torch::Tensor>& stemMags, float exponent);
+};
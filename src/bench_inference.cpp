@@ -0,0 +1,588 @@
+#include <torch/torch.h>
+#include <torch/script.h>
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "ModelSession.h"
+#include "InferenceScheduler.h"
+#include "LarsNetLayers.h"
+#include "StftEngine.h"
+#include "PolyphaseResampler.h"
+#include "AudioTensor.h"
+#include "MusicSourceSep.h"
+#include "LiveSeparator.h"
+#include "Timing.h"
+
+// Benchmarks for the LarsNet inference path. Run from the build folder:
+//   ./LARSBenchmark [seconds of audio, default 30]
+// LARS_MODEL_PACK=<build folder>/LARS.modelpack points it at the models.
+// LARS_PRECISION=int8 or bf16 runs the session benchmarks on the reduced-precision stem models.
+
+static torch::Tensor makeDummySpectrogram(double seconds)
+{
+    // 44.1 kHz, hop 1024, n_fft 4096 -> 2049 bins
+    const int64_t frames = static_cast<int64_t>(seconds * 44100.0 / 1024.0) + 1;
+    return torch::rand({ 1, 2, 2049, frames });
+}
+
+static void benchConcurrentStems(const ModelSession& session, const torch::Tensor& mag)
+{
+    InferenceScheduler scheduler;
+    InferenceScheduler::SpeedupReport report = scheduler.measureSpeedup(session, mag);
+
+    std::cout << "== concurrent stems ==" << std::endl;
+    std::cout << "thread budget: " << scheduler.getTotalThreads() << " (" << report.budget.interOpThreads
+              << " stems x " << report.budget.intraOpThreadsPerJob << " intra-op threads)" << std::endl;
+    std::cout << "sequential: " << report.sequentialMs << " ms" << std::endl;
+    std::cout << "concurrent: " << report.concurrentMs << " ms" << std::endl;
+    std::cout << "speedup:    " << report.getSpeedup() << "x" << std::endl;
+}
+
+static void benchEnsemble(const ModelSession& session, const torch::Tensor& mag)
+{
+    std::cout << "== fused ensemble ==" << std::endl;
+
+    if (!session.isEnsembleLoaded())
+    {
+        std::cout << "not available (run net/export_ensemble.py, then rebuild the model pack)" << std::endl;
+        return;
+    }
+
+    InferenceScheduler scheduler;
+    InferenceScheduler::SpeedupReport report = scheduler.measureEnsembleSpeedup(session, mag);
+
+    std::cout << "five stem models: " << report.sequentialMs << " ms" << std::endl;
+    std::cout << "ensemble:         " << report.concurrentMs << " ms" << std::endl;
+    std::cout << "speedup:          " << report.getSpeedup() << "x" << std::endl;
+}
+
+static void benchOptimizedModules(const ModelSession& session, const torch::Tensor& mag)
+{
+    std::cout << "== frozen + optimize_for_inference ==" << std::endl;
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        const auto stem = static_cast<ModelSession::Stem>(i);
+        ModelSession::LatencyComparison comparison = session.compareOptimizedLatency(stem, mag);
+
+        std::cout << ModelSession::getStemName(stem) << ": scripted " << comparison.scriptedMs << " ms, optimized "
+                  << comparison.optimizedMs << " ms, speedup " << comparison.getSpeedup() << "x" << std::endl;
+    }
+}
+
+static void benchReducedPrecision(const ModelSession& session, ModelSession::Precision reduced, bool isAvailable,
+                                  const char* howToEnable, const torch::Tensor& mag)
+{
+    std::cout << "== " << ModelSession::getPrecisionName(reduced) << " stem models ==" << std::endl;
+
+    if (!isAvailable)
+    {
+        std::cout << "not available (" << howToEnable << ")" << std::endl;
+        return;
+    }
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        const auto stem = static_cast<ModelSession::Stem>(i);
+        ModelSession::PrecisionComparison comparison = session.comparePrecisionLatency(stem, reduced, mag);
+
+        std::cout << ModelSession::getStemName(stem) << ": float32 " << comparison.float32Ms << " ms, "
+                  << ModelSession::getPrecisionName(reduced) << " " << comparison.reducedMs << " ms, speedup "
+                  << comparison.getSpeedup() << "x" << std::endl;
+    }
+}
+
+static void benchBackends(const ModelSession& session, const torch::Tensor& mag)
+{
+    std::cout << "== inference backends ==" << std::endl;
+
+    bool anyConfigured = false;
+
+    for (int i = 0; i < ModelSession::numStems; ++i)
+    {
+        const auto stem = static_cast<ModelSession::Stem>(i);
+        const BackendConfig::Entry entry = session.getBackendConfig().getEntry(ModelSession::getStemName(stem));
+
+        if (entry.type == BackendConfig::Type::torchJit && !entry.channelsLast)
+            continue;
+
+        anyConfigured = true;
+
+        if (!BackendConfig::isTypeAvailable(entry.type))
+        {
+            std::cout << ModelSession::getStemName(stem) << ": " << BackendConfig::getTypeName(entry.type)
+                      << " not available in this build" << std::endl;
+            continue;
+        }
+
+        std::unique_ptr<InferenceBackend> reference = session.createStemBackend(stem, {});
+        std::unique_ptr<InferenceBackend> candidate = session.createStemBackend(stem, entry);
+
+        // warm up both, and check they agree on the same input
+        torch::Tensor expected, actual;
+        for (int run = 0; run < 3; ++run)
+        {
+            expected = reference->run(mag);
+            actual = candidate->run(mag);
+        }
+
+        const double referenceMs = timeBestOf(3, [&] { reference->run(mag); });
+        const double candidateMs = timeBestOf(3, [&] { candidate->run(mag); });
+        const float maxError = (expected - actual).abs().max().item<float>();
+
+        std::cout << ModelSession::getStemName(stem) << ": " << reference->getName() << " " << referenceMs << " ms, "
+                  << candidate->getName() << " " << candidateMs << " ms, speedup " << referenceMs / candidateMs
+                  << "x, max abs diff " << maxError << std::endl;
+    }
+
+    if (!anyConfigured)
+        std::cout << "every stem uses the libtorch JIT (set LARS_BACKEND_CONFIG to compare others)" << std::endl;
+}
+
+static void benchLayouts(const ModelSession& session, const torch::Tensor& mag)
+{
+    std::cout << "== layer timings, nchw vs channels-last (kick) ==" << std::endl;
+
+    // every stem has the same architecture, one is enough to compare layouts
+    const torch::jit::script::Module unet = session.loadStemModule(ModelSession::kick);
+    const torch::Tensor segments = LarsNetSegmentAdapter::foldSegments(mag).narrow(-2, 0, LarsNetSegmentAdapter::modelBins).contiguous();
+
+    const LarsNetLayerBackend nchw(unet, LarsNetLayerBackend::Layout::contiguous);
+    const LarsNetLayerBackend channelsLast(unet, LarsNetLayerBackend::Layout::channelsLast);
+    const TorchJitBackend scripted(unet);
+    const TorchJitBackend optimized(ModelSession::optimizeForInference(unet));
+
+    // best of a few runs per layer, after the profiling runs
+    auto bestLayerTimes = [&segments](const LarsNetLayerBackend& backend)
+    {
+        std::vector<LarsNetLayerBackend::LayerTiming> best;
+
+        for (int run = 0; run < 6; ++run)
+        {
+            std::vector<LarsNetLayerBackend::LayerTiming> timings;
+            backend.runTimed(segments, timings);
+
+            if (run < 3)
+                continue;
+
+            if (best.empty())
+                best = timings;
+            else
+                for (size_t i = 0; i < best.size(); ++i)
+                    best[i].ms = std::min(best[i].ms, timings[i].ms);
+        }
+
+        return best;
+    };
+
+    const std::vector<LarsNetLayerBackend::LayerTiming> nchwTimes = bestLayerTimes(nchw);
+    const std::vector<LarsNetLayerBackend::LayerTiming> channelsLastTimes = bestLayerTimes(channelsLast);
+
+    double nchwTotal = 0.0, channelsLastTotal = 0.0;
+    for (size_t i = 0; i < nchwTimes.size(); ++i)
+    {
+        std::cout << nchwTimes[i].name << ": nchw " << nchwTimes[i].ms << " ms, channels-last "
+                  << channelsLastTimes[i].ms << " ms" << std::endl;
+
+        nchwTotal += nchwTimes[i].ms;
+        channelsLastTotal += channelsLastTimes[i].ms;
+    }
+
+    std::cout << "total: nchw " << nchwTotal << " ms, channels-last " << channelsLastTotal << " ms, speedup "
+              << nchwTotal / channelsLastTotal << "x" << std::endl;
+
+    const float maxError = (nchw.run(segments) - channelsLast.run(segments)).abs().max().item<float>();
+    std::cout << "max abs diff between layouts: " << maxError << std::endl;
+
+    // whole-graph references: the scripted module with the N x F x C x T transposes, and the
+    // frozen graph that optimize_for_inference keeps in the oneDNN blocked layout
+    for (int run = 0; run < 3; ++run)
+    {
+        scripted.run(segments);
+        optimized.run(segments);
+    }
+
+    std::cout << "whole graph: scripted " << timeBestOf(3, [&] { scripted.run(segments); }) << " ms, frozen (oneDNN blocked) "
+              << timeBestOf(3, [&] { optimized.run(segments); }) << " ms" << std::endl;
+}
+
+// false if batched windows don't come out exactly as one window at a time,
+// OverlapAddSettings::batchSize has to stay 1 on this machine then
+static bool benchDemucsBatching(const ModelSession& session, int numWindows)
+{
+    std::cout << "== htdemucs, batched windows ==" << std::endl;
+
+    if (!session.isDemucsLoaded())
+    {
+        std::cout << "not available (no htdemucs in the model pack)" << std::endl;
+        return true;
+    }
+
+    const torch::Tensor windows = torch::rand({ numWindows, 2, 485100 }) * 2.0f - 1.0f;
+
+    auto runPerWindow = [&]
+    {
+        std::vector<torch::Tensor> outputs;
+        for (int i = 0; i < numWindows; ++i)
+            outputs.push_back(session.inferDemucs(windows.narrow(0, i, 1)));
+
+        return torch::cat(outputs, 0);
+    };
+
+    const torch::Tensor expected = runPerWindow();
+    const torch::Tensor actual = session.inferDemucs(windows);
+
+    const double perWindowMs = timeBestOf(2, [&] { runPerWindow(); });
+    const double batchedMs = timeBestOf(2, [&] { session.inferDemucs(windows); });
+
+    std::cout << numWindows << " windows: per window " << perWindowMs << " ms, batched " << batchedMs << " ms, speedup "
+              << perWindowMs / batchedMs << "x" << std::endl;
+
+    if (!torch::equal(expected, actual))
+    {
+        std::cerr << "FAILED: batched windows differ from one window at a time (max abs diff "
+                  << (expected - actual).abs().max().item<float>() << "), keep OverlapAddSettings::batchSize at 1" << std::endl;
+        return false;
+    }
+
+    std::cout << "batched output bit-identical: passed" << std::endl;
+    return true;
+}
+
+static void benchStft(double seconds)
+{
+    std::cout << "== stft / istft, StftEngine against torch ==" << std::endl;
+
+    const StftEngine& engine = StftEngine::get(4096, 1024);
+    const torch::Tensor& window = engine.getWindow();
+    const torch::Tensor audio = torch::rand({ 2, static_cast<int64_t>(seconds * 44100.0) }) * 2.0f - 1.0f;
+
+    const StftEngine::Validation validation = engine.validate(audio);
+    std::cout << "max abs error: stft " << validation.stftMaxError << ", istft " << validation.istftMaxError
+              << ", masked istft " << validation.maskedMaxError << std::endl;
+
+    const torch::Tensor spec = engine.stft(audio);
+    const double torchStftMs = timeBestOf(3, [&] { torch::stft(audio, 4096, 1024, 4096, window, true, "reflect", false, true, true); });
+    const double engineStftMs = timeBestOf(3, [&] { engine.stft(audio); });
+    const double torchIstftMs = timeBestOf(3, [&] { torch::istft(spec, 4096, 1024, 4096, window, true, false, true, audio.size(1), false); });
+    const double engineIstftMs = timeBestOf(3, [&] { engine.istft(spec, audio.size(1)); });
+
+    std::cout << "stft: torch " << torchStftMs << " ms, engine " << engineStftMs << " ms, speedup " << torchStftMs / engineStftMs << "x" << std::endl;
+    std::cout << "istft: torch " << torchIstftMs << " ms, engine " << engineIstftMs << " ms, speedup " << torchIstftMs / engineIstftMs << "x" << std::endl;
+
+    // the frames are spread over the intra-op threads, each transforming with its own FFT
+    const int maxThreads = at::get_num_threads();
+    std::vector<int> threadCounts;
+    for (int numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+        threadCounts.push_back(numThreads);
+
+    threadCounts.push_back(maxThreads);
+    double oneThreadMs = 0.0;
+
+    std::cout << "stft + istft thread scaling:";
+    for (int numThreads : threadCounts)
+    {
+        at::set_num_threads(numThreads);
+        const double ms = timeBestOf(3, [&] { engine.istft(engine.stft(audio), audio.size(1)); });
+        oneThreadMs = numThreads == 1 ? ms : oneThreadMs;
+
+        std::cout << " " << at::get_num_threads() << " threads " << ms << " ms (" << oneThreadMs / ms << "x)";
+    }
+    std::cout << std::endl;
+
+    at::set_num_threads(maxThreads);
+
+    // five made-up stems, one masked iSTFT each against all of them in one batch
+    const torch::Tensor magnitude = torch::abs(spec);
+    const StftEngine::Mixture mixture = engine.prepareMixture(spec, magnitude);
+
+    std::vector<torch::Tensor> stemMags;
+    for (int i = 0; i < ModelSession::numStems; ++i)
+        stemMags.push_back(magnitude * torch::rand_like(magnitude));
+
+    auto runPerStem = [&]
+    {
+        std::vector<torch::Tensor> stems;
+        for (const torch::Tensor& stemMag : stemMags)
+            stems.push_back(engine.istftMasked(mixture, stemMag, audio.size(1)));
+
+        return torch::stack(stems);
+    };
+
+    const bool identical = torch::equal(runPerStem(), engine.istftMasked(mixture, stemMags, audio.size(1)));
+    const double perStemMs = timeBestOf(3, [&] { runPerStem(); });
+    const double batchedMs = timeBestOf(3, [&] { engine.istftMasked(mixture, stemMags, audio.size(1)); });
+
+    std::cout << "masked istft of " << stemMags.size() << " stems: per stem " << perStemMs << " ms, batched " << batchedMs
+              << " ms, speedup " << perStemMs / batchedMs << "x, bit-identical: " << (identical ? "yes" : "no") << std::endl;
+}
+
+static void benchResampler(double seconds)
+{
+    std::cout << "== PolyphaseResampler ==" << std::endl;
+
+    const double rates[][2] = { { 48000.0, 44100.0 }, { 44100.0, 48000.0 }, { 96000.0, 44100.0 }, { 44100.0, 96000.0 } };
+
+    for (const auto& rate : rates)
+    {
+        const double inputRate = rate[0];
+        const double outputRate = rate[1];
+
+        // a 1 kHz sine, compared against the same sine computed at the output rate
+        const torch::Tensor time = torch::arange(static_cast<int64_t>(seconds * inputRate), torch::kFloat64) / inputRate;
+        const torch::Tensor audio = torch::sin(time * 2000.0 * juce::MathConstants<double>::pi).to(torch::kFloat32).expand({ 2, -1 }).contiguous();
+
+        const torch::Tensor whole = PolyphaseResampler::resample(audio, inputRate, outputRate);
+        const torch::Tensor expectedTime = torch::arange(whole.size(1), torch::kFloat64) / outputRate;
+        const torch::Tensor expected = torch::sin(expectedTime * 2000.0 * juce::MathConstants<double>::pi).to(torch::kFloat32);
+
+        // the first and last 100 ms see the silence around the signal
+        const int64_t edge = static_cast<int64_t>(0.1 * outputRate);
+        const torch::Tensor error = (whole[0] - expected).narrow(0, edge, whole.size(1) - 2 * edge);
+        const double snr = 10.0 * std::log10(0.5 / error.pow(2).mean().item<double>());
+
+        // streamed in host-sized blocks it has to come out the same
+        PolyphaseResampler streaming(inputRate, outputRate);
+        std::vector<torch::Tensor> blocks;
+        for (int64_t start = 0; start < audio.size(1); start += 512)
+            blocks.push_back(streaming.process(audio.narrow(1, start, std::min<int64_t>(512, audio.size(1) - start))));
+        blocks.push_back(streaming.finish());
+
+        const bool identical = torch::equal(torch::cat(blocks, 1), whole);
+        const double ms = timeBestOf(3, [&] { PolyphaseResampler::resample(audio, inputRate, outputRate); });
+
+        std::cout << inputRate << " -> " << outputRate << " Hz: " << ms << " ms for " << seconds << " s of stereo ("
+                  << seconds * 1000.0 / ms << "x realtime), sine SNR " << snr << " dB, streamed bit-identical: "
+                  << (identical ? "yes" : "no") << std::endl;
+    }
+}
+
+static void benchHandOffs(double seconds)
+{
+    std::cout << "== audio hand-offs of one separation, bytes copied before and after AudioTensor ==" << std::endl;
+
+    c10::InferenceMode guard(true);
+
+    const int numSamples = static_cast<int>(seconds * ModelSession::sampleRate);
+    const int numOutputs = ModelSession::numStems + 1; // the stems and the HTDemucs drums
+    const juce::int64 trackBytes = 2 * static_cast<juce::int64>(numSamples) * static_cast<juce::int64>(sizeof(float));
+
+    // the track as a WAV in memory, both paths decode it; HTDemucs is left out, its windows stand in for its output
+    juce::MemoryBlock wav;
+    {
+        juce::AudioBuffer<float> noise(2, numSamples);
+        juce::Random random;
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                noise.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(new juce::MemoryOutputStream(wav, false),
+                                                                              ModelSession::sampleRate, 2, 32, {}, 0));
+        writer->writeFromAudioSampleBuffer(noise, 0, numSamples);
+    }
+
+    auto openReader = [&wav]
+    {
+        juce::WavAudioFormat format;
+        return std::unique_ptr<juce::AudioFormatReader>(format.createReaderFor(new juce::MemoryInputStream(wav, false), true));
+    };
+
+    const OverlapAddSettings settings;
+    const std::vector<AudioWindow> layout = getWindowLayout(numSamples, settings);
+
+    // what the editor used to do, every copy counted by hand
+    juce::int64 legacyBytes = 0;
+    auto runLegacy = [&]
+    {
+        legacyBytes = 0;
+
+        std::unique_ptr<juce::AudioFormatReader> reader = openReader();
+        juce::AudioBuffer<float> buffer(2, numSamples);
+        reader->read(&buffer, 0, numSamples, 0, true, true);
+
+        // from_blob per channel, then cat
+        const torch::Tensor left = torch::from_blob(buffer.getWritePointer(0), { 1, numSamples });
+        const torch::Tensor right = torch::from_blob(buffer.getWritePointer(1), { 1, numSamples });
+        const torch::Tensor fileTensor = torch::cat({ left, right }, 0);
+        legacyBytes += trackBytes;
+
+        // a std::vector per window, then from_blob(...).clone()
+        std::vector<torch::Tensor> windows;
+        for (const AudioWindow& window : layout)
+        {
+            const int length = static_cast<int>(juce::jmin<juce::int64>(window.length, numSamples - window.start));
+            std::vector<float> data;
+
+            for (int ch = 0; ch < 2; ++ch)
+            {
+                const float* channel = fileTensor[ch].data_ptr<float>() + window.start;
+                data.insert(data.end(), channel, channel + length);
+                data.insert(data.end(), static_cast<size_t>(window.length - length), 0.0f);
+            }
+
+            windows.push_back(torch::from_blob(data.data(), { 2, window.length }).clone());
+            legacyBytes += 2 * 2 * static_cast<juce::int64>(window.length) * static_cast<juce::int64>(sizeof(float));
+        }
+
+        // the drums split into channels by musicSourceSeparation() and concatenated again by the editor
+        const torch::Tensor drums = overlapAdd(windows, layout, numSamples, settings);
+        const torch::Tensor yDrums = torch::cat({ drums.select(0, 0).unsqueeze(0), drums.select(0, 1).unsqueeze(0) }, 0);
+        legacyBytes += trackBytes;
+
+        // CreateWav: a std::vector per channel, then the MemoryAudioSource's own copy
+        for (int i = 0; i < numOutputs; ++i)
+        {
+            const torch::Tensor yL = yDrums[0].contiguous();
+            const torch::Tensor yR = yDrums[1].contiguous();
+            std::vector<float> vectoryL(yL.data_ptr<float>(), yL.data_ptr<float>() + yL.numel());
+            std::vector<float> vectoryR(yR.data_ptr<float>(), yR.data_ptr<float>() + yR.numel());
+
+            float* dataPtrs[2] = { vectoryL.data(), vectoryR.data() };
+            juce::AudioBuffer<float> bufferY(dataPtrs, 2, numSamples);
+            juce::MemoryAudioSource source(bufferY, true, false);
+            legacyBytes += 2 * trackBytes;
+        }
+    };
+
+    auto runAudioTensor = [&]
+    {
+        AudioTensor::resetBytesCopied();
+
+        std::unique_ptr<juce::AudioFormatReader> reader = openReader();
+        const AudioTensor fileAudio = AudioTensor::read(*reader);
+
+        TensorSampleSource source(fileAudio.getTensor());
+        std::vector<torch::Tensor> windows;
+        for (const AudioWindow& window : layout)
+            windows.push_back(readWindow(source, window));
+
+        const AudioTensor drums(overlapAdd(windows, layout, numSamples, settings));
+
+        for (int i = 0; i < numOutputs; ++i)
+        {
+            juce::AudioBuffer<float> bufferY = drums.getBuffer();
+            AudioTensorSource playSource(drums);
+        }
+    };
+
+    const double legacyMs = timeBestOf(3, runLegacy);
+    const double audioTensorMs = timeBestOf(3, runAudioTensor);
+    const juce::int64 audioTensorBytes = AudioTensor::getBytesCopied();
+
+    auto toMB = [](juce::int64 bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+
+    std::cout << seconds << " s of stereo, " << layout.size() << " windows, " << numOutputs << " outputs" << std::endl;
+    std::cout << "before: " << toMB(legacyBytes) << " MB copied, " << legacyMs << " ms" << std::endl;
+    std::cout << "after:  " << toMB(audioTensorBytes) << " MB copied, " << audioTensorMs << " ms, "
+              << static_cast<double>(legacyBytes) / static_cast<double>(juce::jmax<juce::int64>(1, audioTensorBytes)) << "x fewer bytes" << std::endl;
+}
+
+// false if audio left from before a reset() still comes out after it: switching live
+// mode back on has to start from the primed silence, or the delay isn't the reported one
+static bool checkLiveReset(const ModelSession& session)
+{
+    std::cout << "== live mode, reset ==" << std::endl;
+
+    InferenceScheduler scheduler;
+    LiveSeparator live(session, scheduler);
+    live.prepare(512);
+    live.start();
+    const int primedSamples = live.getNumOutputReady();
+
+    // a few hops of noise, then wait until the background thread has separated one
+    juce::AudioBuffer<float> block(2, 512);
+    juce::Random random;
+
+    for (int i = 0; i < 2 * LiveSeparator::hopFrames * LiveSeparator::hopLength / block.getNumSamples(); ++i)
+    {
+        for (int ch = 0; ch < 2; ++ch)
+            for (int n = 0; n < block.getNumSamples(); ++n)
+                block.setSample(ch, n, random.nextFloat() * 2.0f - 1.0f);
+
+        live.pushInput(block, 2);
+    }
+
+    for (int waitedMs = 0; live.getNumOutputReady() <= primedSamples && waitedMs < 10000; waitedMs += 10)
+        juce::Thread::sleep(10);
+
+    if (live.getNumOutputReady() <= primedSamples)
+        std::cout << "no hop separated within 10 s, only the input side is checked" << std::endl;
+
+    live.release();
+    live.reset();
+
+    bool passed = live.getNumOutputReady() == primedSamples && live.getNumUnderruns() == 0;
+
+    // with the thread stopped, what's queued is all there is, and it has to be silence
+    while (passed && live.getNumOutputReady() >= block.getNumSamples())
+    {
+        live.popOutput(block);
+        passed = block.getMagnitude(0, block.getNumSamples()) == 0.0f;
+    }
+
+    std::cout << (passed ? "output after reset starts from silence: passed" : "FAILED: output after reset isn't the primed silence")
+              << std::endl;
+    return passed;
+}
+
+static bool checkLiveHopTime(const ModelSession& session)
+{
+    std::cout << "== live mode, one hop against real time ==" << std::endl;
+
+    InferenceScheduler scheduler;
+    LiveSeparator live(session, scheduler);
+    live.prepare(512);
+
+    // the stems run on a whole 512-frame segment every hop, it has to finish before the next hop of input is in
+    const double hopMs = live.measureHopMs();
+    const bool passed = hopMs < LiveSeparator::getHopMs();
+
+    std::cout << "hop of " << LiveSeparator::hopFrames << " frames with " << LiveSeparator::contextFrames
+              << " frames of context: " << hopMs << " ms of " << LiveSeparator::getHopMs() << " ms: "
+              << (passed ? "passed" : "FAILED, live mode will underrun") << std::endl;
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI libraryInitialiser;
+
+    const double seconds = (argc > 1) ? std::atof(argv[1]) : 30.0;
+
+    ModelSession session;
+    session.loadModels();
+
+    if (!session.areStemModelsLoaded())
+    {
+        std::cerr << "Error loading the LarsNet modules." << std::endl;
+        return -1;
+    }
+
+    session.warmUp();
+
+    const torch::Tensor mag = makeDummySpectrogram(seconds);
+    std::cout << "input spectrogram: " << mag.sizes() << std::endl;
+    std::cout << "stem precision: " << ModelSession::getPrecisionName(session.getActivePrecision()) << std::endl;
+
+    benchConcurrentStems(session, mag);
+    benchBackends(session, mag);
+    benchEnsemble(session, mag);
+    benchOptimizedModules(session, mag);
+    benchLayouts(session, mag);
+    benchReducedPrecision(session, ModelSession::Precision::int8, session.isInt8Available(),
+                          "run net/quantize_stems.py, then rebuild the model pack", mag);
+    benchReducedPrecision(session, ModelSession::Precision::bfloat16, ModelSession::isBFloat16Available(),
+                          "this CPU has neither AVX512-BF16 nor AMX", mag);
+    const bool batchingIdentical = benchDemucsBatching(session, 4);
+    benchStft(seconds);
+    benchResampler(seconds);
+    benchHandOffs(seconds);
+    const bool liveResets = checkLiveReset(session);
+    const bool liveKeepsUp = checkLiveHopTime(session);
+
+    return batchingIdentical && liveResets && liveKeepsUp ? 0 : 1;
+}
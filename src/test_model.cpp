@@ -7,26 +7,25 @@
 #include <vector>
 #include <string>
 
-// Function to get an audio buffer from a file
-juce::AudioBuffer<float> getAudioBufferFromFile(juce::File file, juce::AudioFormatManager &formatManager, double &sampleRate)
+#include "AudioTensor.h"
+
+// Function to get the audio of a file, stereo, straight into a tensor
+AudioTensor getAudioTensorFromFile(juce::File file, juce::AudioFormatManager &formatManager, double &sampleRate)
 {
-    auto *reader = formatManager.createReaderFor(file);
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
     if (reader == nullptr)
     {
         throw std::runtime_error("Failed to create reader for audio file.");
     }
     sampleRate = reader->sampleRate;
-    juce::AudioBuffer<float> audioBuffer;
-    audioBuffer.setSize(reader->numChannels, static_cast<int>(reader->lengthInSamples));
-    reader->read(&audioBuffer, 0, static_cast<int>(reader->lengthInSamples), 0, true, true);
-    delete reader;
-    return audioBuffer;
+    return AudioTensor::read(*reader);
 }
 
-std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<float> &audioBuffer, int window_size, int stride)
+std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(const AudioTensor &audio, int window_size, int stride)
 {
-    int numSamples = audioBuffer.getNumSamples();
-    int numChannels = audioBuffer.getNumChannels();
+    const torch::Tensor &samples = audio.getTensor();
+    int numSamples = static_cast<int>(audio.getNumSamples());
+    int numChannels = audio.getNumChannels();
     int num_windows = (numSamples + stride - 1) / stride; 
 
     std::vector<torch::Tensor> windows;
@@ -35,20 +34,17 @@ std::vector<torch::Tensor> adjustAudioBufferToExpectedLength(juce::AudioBuffer<f
         int start = i * stride;
         int end = std::min(start + window_size, numSamples);
 
-        std::vector<float> windowData;
-        for (int ch = 0; ch < numChannels; ++ch) {
-            const float* channelData = audioBuffer.getReadPointer(ch) + start;
-            windowData.insert(windowData.end(), channelData, channelData + (end - start));
-
-            // Check if this is the last window and needs padding for the current channel
-            if ((end - start) < window_size) {
-                int paddingSize = window_size - (end - start);
-                windowData.insert(windowData.end(), paddingSize, 0.0f); // Zero padding for the current channel
-            }
+        // full windows are views of the track, only the last one is copied to be zero-padded
+        torch::Tensor tensor;
+        if ((end - start) == window_size) {
+            tensor = samples.narrow(1, start, window_size);
+        }
+        else {
+            tensor = torch::zeros({numChannels, window_size});
+            tensor.narrow(1, 0, end - start).copy_(samples.narrow(1, start, end - start));
+            AudioTensor::countCopy(static_cast<juce::int64>(numChannels) * (end - start) * static_cast<juce::int64>(sizeof(float)));
         }
 
-
-        torch::Tensor tensor = torch::from_blob(windowData.data(), {numChannels, window_size}, torch::kFloat32).clone();
         std::cout << " shape tensor in adjustAudioBufferToExpectedLength: " << tensor.sizes() << std::endl;
 
         windows.push_back(tensor);
@@ -93,15 +89,15 @@ int main()
     juce::AudioFormatManager formatManager;
     formatManager.registerBasicFormats();
 
-    // Load the audio file into a JUCE audio buffer
+    // Load the audio file into a tensor, read as stereo (mono is duplicated)
     double sampleRate;
-    juce::AudioBuffer<float> audioBuffer; 
+    AudioTensor audio;
     try
     {
         juce::File inputFile(inputFilePath);
-        audioBuffer = getAudioBufferFromFile(inputFile, formatManager, sampleRate);
+        audio = getAudioTensorFromFile(inputFile, formatManager, sampleRate);
         std::cout << "Audio file loaded successfully." << std::endl;
-        printBufferShape(audioBuffer, "Initial audioBuffer");
+        printTensorShape(audio.getTensor(), "Initial audio");
     }
     catch (const std::runtime_error &e)
     {
@@ -109,26 +105,13 @@ int main()
         return -1;
     }
 
-    // Ensure the audio buffer has 2 channels (stereo)
-    if (audioBuffer.getNumChannels() != 2)
-    {
-        juce::AudioBuffer<float> stereoBuffer(2, audioBuffer.getNumSamples());
-        stereoBuffer.copyFrom(0, 0, audioBuffer, 0, 0, audioBuffer.getNumSamples());
-        if (audioBuffer.getNumChannels() == 1)
-        {
-            stereoBuffer.copyFrom(1, 0, audioBuffer, 0, 0, audioBuffer.getNumSamples());
-        }
-        audioBuffer = std::move(stereoBuffer);
-        printBufferShape(audioBuffer, "Stereo audioBuffer");
-    }
-
-    int numSamples = audioBuffer.getNumSamples();
+    int numSamples = static_cast<int>(audio.getNumSamples());
     const int expectedSamples = 485100;
     const int window_size = 485100;
     const int stride = 485100;
 
     // Adjust the audio buffer to the expected length
-    std::vector<torch::Tensor> audioWindows = adjustAudioBufferToExpectedLength(audioBuffer, window_size, stride);
+    std::vector<torch::Tensor> audioWindows = adjustAudioBufferToExpectedLength(audio, window_size, stride);
     printTensorShape(audioWindows[0], "audioWindows[0]");
     printTensorShape(audioWindows[1], "audioWindows[1]");
     //printTensorShape(audioWindows[2], "audioWindows[2]");
@@ -142,7 +125,7 @@ int main()
         std::vector<torch::Tensor> selectedParts;
         for (int i=0;i<numTensors;i++){
             torch::Tensor audioTensor;
-            audioTensor = torch::cat(audioWindows[i], 0).unsqueeze(0); // Add batch dimension
+            audioTensor = audioWindows[i].unsqueeze(0); // Add batch dimension
             printTensorShape(audioTensor, "audioTensor");
 
             
@@ -174,18 +157,11 @@ int main()
     torch::Tensor drums = output[0]; 
     printTensorShape(drums, "drums tensor");
 
-    // Create a JUCE audio buffer from the output tensor
-    juce::AudioBuffer<float> drumsBuffer(2, drums.size(1)); // Ensure the buffer has 2 channels
-    auto drumsAccessor = drums.accessor<float, 2>(); // Accessor
-    for (int ch = 0; ch < drumsBuffer.getNumChannels(); ++ch)
-    {
-        float *channelData = drumsBuffer.getWritePointer(ch);
-        for (int sample = 0; sample < drums.size(1); ++sample)
-        {
-            channelData[sample] = drumsAccessor[ch % drums.size(0)][sample];
-        }
-    }
+    // A JUCE audio buffer over the output tensor's samples
+    AudioTensor drumsAudio(drums);
+    juce::AudioBuffer<float> drumsBuffer = drumsAudio.getBuffer();
     printBufferShape(drumsBuffer, "drumsBuffer");
+    std::cout << "Bytes copied handing the audio over: " << AudioTensor::getBytesCopied() << std::endl;
 
     // Save the audio buffer to a file
     juce::File outputFile(outputFilePath);